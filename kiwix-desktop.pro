@@ -58,6 +58,7 @@ DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs depr
 
 
 SOURCES += \
+    src/booksearchindex.cpp \
     src/choiceitem.cpp \
     src/contentmanagerdelegate.cpp \
     src/contentmanagerheader.cpp \
@@ -104,12 +105,15 @@ SOURCES += \
     src/localkiwixserver.cpp \
     src/fullscreenwindow.cpp \
     src/fullscreennotification.cpp \
+    src/zimintegritychecker.cpp \
     src/zimview.cpp \
     src/multizimbutton.cpp \
 
 qtHaveModule(texttospeech): SOURCES += src/texttospeechbar.cpp \
 
 HEADERS += \
+    src/bookrecord.h \
+    src/booksearchindex.h \
     src/choiceitem.h \
     src/contentmanagerdelegate.h \
     src/contentmanagerheader.h \
@@ -158,6 +162,7 @@ HEADERS += \
     src/fullscreenwindow.h \
     src/fullscreennotification.h \
     src/menuproxystyle.h \
+    src/zimintegritychecker.h \
     src/zimview.h \
     src/portutils.h \
     src/css_constants.h \
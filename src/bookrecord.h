@@ -0,0 +1,48 @@
+#ifndef BOOKRECORD_H
+#define BOOKRECORD_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// Data of a book as displayed by the content manager. It is filled directly
+// from a kiwix::Book, and display strings (e.g. the formatted size) are
+// derived from it on demand.
+struct BookRecord
+{
+    QString id;
+    QString title;
+    QString description;
+    QString date;
+    QString tags;
+    quint64 size = 0;
+
+    // Case-folded title, precomputed for sorting
+    QString titleSortKey;
+
+    // A valid ZIM file is associated with the book. The favicon of such a
+    // book is loaded from the ZIM file on demand, for the other books only
+    // the URL of the favicon is known.
+    bool isLocal = false;
+    QByteArray faviconData;
+    QString faviconUrl;
+
+    bool operator==(const BookRecord& other) const
+    {
+        return id == other.id
+            && title == other.title
+            && description == other.description
+            && date == other.date
+            && tags == other.tags
+            && size == other.size
+            && isLocal == other.isLocal
+            && faviconData == other.faviconData
+            && faviconUrl == other.faviconUrl;
+    }
+
+    bool operator!=(const BookRecord& other) const { return !(*this == other); }
+};
+
+typedef QVector<BookRecord> BookRecordList;
+
+#endif // BOOKRECORD_H
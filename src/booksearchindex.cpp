@@ -0,0 +1,141 @@
+#include "booksearchindex.h"
+
+#include <QRegularExpression>
+
+QStringList BookSearchIndex::tokenize(const QString& text)
+{
+    static const QRegularExpression diacriticalMarks(R"(\p{M})");
+    static const QRegularExpression separators(R"([^\p{L}\p{N}]+)");
+
+    QString normalized = text.normalized(QString::NormalizationForm_KD).toLower();
+    normalized.remove(diacriticalMarks);
+    QStringList tokens;
+    for (const auto& token : normalized.split(separators)) {
+        if (!token.isEmpty())
+            tokens.append(token);
+    }
+    return tokens;
+}
+
+namespace
+{
+
+QString getBookText(const kiwix::Book& book)
+{
+    QString text = QString::fromStdString(book.getTitle())
+                 + " " + QString::fromStdString(book.getDescription())
+                 + " " + QString::fromStdString(book.getName());
+
+    // Tags starting with an underscore are technical ones (e.g. _pictures:yes)
+    for (const auto& tag : QString::fromStdString(book.getTags()).split(';')) {
+        if (!tag.startsWith('_'))
+            text += " " + tag;
+    }
+    return text;
+}
+
+} // unnamed namespace
+
+void BookSearchIndex::sync(const kiwix::Library& library)
+{
+    const auto revision = library.getRevision();
+    if (m_synced && revision == m_syncedRevision)
+        return;
+
+    QSet<QString> bookIds;
+    for (const auto& id : library.getBooksIds()) {
+        const QString bookId = QString::fromStdString(id);
+        bookIds.insert(bookId);
+        try {
+            const kiwix::Book& book = library.getBookById(id);
+            const auto it = m_bookIdToIndex.constFind(bookId);
+            if (it == m_bookIdToIndex.constEnd()
+                || m_books.value(it.value()).textHash != qHash(getBookText(book))) {
+                addBook(book);
+            }
+        } catch (const std::out_of_range&) {
+            // the book was removed in the meantime
+        }
+    }
+
+    for (const auto& bookId : m_bookIdToIndex.keys()) {
+        if (!bookIds.contains(bookId))
+            removeBook(bookId);
+    }
+
+    m_synced = true;
+    m_syncedRevision = revision;
+}
+
+void BookSearchIndex::addBook(const kiwix::Book& book)
+{
+    const QString bookId = QString::fromStdString(book.getId());
+    removeBook(bookId);
+
+    const QString text = getBookText(book);
+    QStringList tokens = tokenize(text);
+    tokens.removeDuplicates();
+
+    const BookIndex bookIndex = m_nextBookIndex++;
+    const IndexedBook indexedBook{bookId, qHash(text), tokens};
+    for (const auto& token : indexedBook.tokens) {
+        m_tokenToBooks[token].insert(bookIndex);
+    }
+    m_bookIdToIndex.insert(bookId, bookIndex);
+    m_books.insert(bookIndex, indexedBook);
+}
+
+void BookSearchIndex::removeBook(const QString& bookId)
+{
+    const auto it = m_bookIdToIndex.find(bookId);
+    if (it == m_bookIdToIndex.end())
+        return;
+
+    const BookIndex bookIndex = it.value();
+    for (const auto& token : m_books.value(bookIndex).tokens) {
+        auto& booksWithToken = m_tokenToBooks[token];
+        booksWithToken.remove(bookIndex);
+        if (booksWithToken.isEmpty())
+            m_tokenToBooks.remove(token);
+    }
+    m_books.remove(bookIndex);
+    m_bookIdToIndex.erase(it);
+}
+
+void BookSearchIndex::clear()
+{
+    m_tokenToBooks.clear();
+    m_bookIdToIndex.clear();
+    m_books.clear();
+    m_synced = false;
+}
+
+QSet<QString> BookSearchIndex::search(const QString& query) const
+{
+    QSet<BookIndex> matches;
+    bool firstWord = true;
+    for (const auto& word : tokenize(query)) {
+        QSet<BookIndex> wordMatches;
+        for (auto it = m_tokenToBooks.lowerBound(word);
+             it != m_tokenToBooks.constEnd() && it.key().startsWith(word);
+             ++it) {
+            wordMatches.unite(it.value());
+        }
+
+        if (firstWord) {
+            matches = wordMatches;
+            firstWord = false;
+        } else {
+            matches.intersect(wordMatches);
+        }
+
+        if (matches.isEmpty())
+            break;
+    }
+
+    QSet<QString> bookIds;
+    for (const auto bookIndex : matches) {
+        bookIds.insert(m_books.value(bookIndex).id);
+    }
+    return bookIds;
+}
@@ -0,0 +1,55 @@
+#ifndef BOOKSEARCHINDEX_H
+#define BOOKSEARCHINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <kiwix/library.h>
+
+// In-memory token/prefix index over the title, description, name and tags
+// of the books of a kiwix::Library. It allows to narrow down the list of
+// books as the user types, without running a full text query through
+// libkiwix for every keystroke.
+class BookSearchIndex
+{
+public:
+    // Brings the index up to date with library by indexing the books added
+    // or changed and dropping the books removed since the previous call.
+    // Meant for libraries that are filled without going through addBook().
+    void sync(const kiwix::Library& library);
+
+    void addBook(const kiwix::Book& book);
+    void removeBook(const QString& bookId);
+    void clear();
+
+    // Returns the ids of the books having, for every word of query, a word
+    // starting with it.
+    QSet<QString> search(const QString& query) const;
+
+    static QStringList tokenize(const QString& text);
+
+private: // types
+    typedef int BookIndex;
+
+    struct IndexedBook
+    {
+        QString id;
+        // hash of the indexed text, tells whether the book has changed
+        size_t textHash;
+        QStringList tokens;
+    };
+
+private: // data
+    // Sorted by token so that all tokens having a given prefix are adjacent
+    QMap<QString, QSet<BookIndex>> m_tokenToBooks;
+    QHash<QString, BookIndex> m_bookIdToIndex;
+    QHash<BookIndex, IndexedBook> m_books;
+    BookIndex m_nextBookIndex = 0;
+
+    bool m_synced = false;
+    kiwix::Library::Revision m_syncedRevision = 0;
+};
+
+#endif // BOOKSEARCHINDEX_H
@@ -19,6 +19,15 @@
 #include "descriptionnode.h"
 #include "kiwixmessagebox.h"
 #include <QtConcurrent/QtConcurrentRun>
+#include <QStorageInfo>
+#include <QAtomicInt>
+#include <QFuture>
+#include <QThread>
+#include <QSettings>
+#include <QCryptographicHash>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
 #include "contentmanagerheader.h"
 #include <QDesktopServices>
 
@@ -37,6 +46,20 @@ SettingsManager* getSettingsManager()
     return KiwixApp::instance()->getSettingsManager();
 }
 
+bool shouldMoveFilesToTrash()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    return getSettingsManager()->getMoveToTrash();
+#else
+    return false; // we do not support move to trash functionality for qt versions below 5.15
+#endif
+}
+
+QString getBookUpdatesPath()
+{
+    return getDataDirectory() + "/book-updates.ini";
+}
+
 // Opens the directory containing the input file path.
 // parent is the widget serving as the parent for the error dialog in case of
 // failure.
@@ -94,10 +117,42 @@ ContentManager::ContentManager(Library* library)
     connect(this, &ContentManager::filterParamsChanged, this, &ContentManager::updateLibrary);
     connect(this, &ContentManager::booksChanged, this, [=]() {
         updateModel();
-        setCategories();
-        setLanguages();
+        // The remote categories and languages are fetched once per catalog
+        if ( m_local ) {
+            setCategories();
+            setLanguages();
+        }
+        checkLocalBooksIntegrity();
+    });
+    connect(&m_zimIntegrityChecker, &ZimIntegrityChecker::bookChecked, this, [=](QString bookId, bool /*corrupted*/) {
+        emit(oneBookChanged(bookId));
+    });
+    checkLocalBooksIntegrity();
+    connect(this, &ContentManager::oneBookChanged, this, &ContentManager::updateModelRow);
+
+    // Reading ZIM files is I/O bound, allow more threads than there are cores
+    m_zimFileReaderPool.setMaxThreadCount(qMax(4, 2 * QThread::idealThreadCount()));
+
+    // Filter the list of books once the user pauses typing (the catalog
+    // server answers the query for remote books)
+    const int SEARCH_DEBOUNCING_DELAY_MILLISECONDS = 150;
+    m_searchDebounceTimer.setSingleShot(true);
+    m_searchDebounceTimer.setInterval(SEARCH_DEBOUNCING_DELAY_MILLISECONDS);
+    connect(&m_searchDebounceTimer, &QTimer::timeout, this, [=]() {
+        if ( m_local )
+            updateModel();
+        else
+            updateLibrary();
+    });
+    connect(this, &ContentManager::bookRemoved, managerModel, &ContentManagerModel::removeBook);
+    connect(&m_remoteLibraryManager, &OpdsRequestManager::requestBatchReceived, this, &ContentManager::updateRemoteLibrary);
+    connect(&m_remoteLibraryManager, &OpdsRequestManager::requestRefreshed, this, &ContentManager::replaceRemoteLibrary);
+    connect(&m_remoteLibraryManager, &OpdsRequestManager::booksByNameReceived, this, &ContentManager::handleBooksByName);
+    connect(&m_remoteLibraryManager, &OpdsRequestManager::requestCompleted, this, [=](bool morePagesAvailable) {
+        m_remotePageRequestPending = false;
+        m_moreRemotePagesAvailable = morePagesAvailable;
+        emit(pendingRequest(false));
     });
-    connect(&m_remoteLibraryManager, &OpdsRequestManager::requestReceived, this, &ContentManager::updateRemoteLibrary);
     connect(mp_view->getView(), SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(onCustomContextMenu(const QPoint &)));
     connect(this, &ContentManager::pendingRequest, mp_view, &ContentManagerView::showLoader);
     connect(treeView, &QTreeView::doubleClicked, this, &ContentManager::openBookWithIndex);
@@ -116,6 +171,8 @@ ContentManager::ContentManager(Library* library)
             this, &ContentManager::downloadDisappeared);
 
     connect(this, &DownloadManager::error, this, &ContentManager::handleError);
+    connect(getSettingsManager(), &SettingsManager::downloadSchedulingChanged,
+            this, &ContentManager::applyDownloadSettings);
 
     if ( DownloadManager::downloadingFunctionalityAvailable() ) {
         startDownloadUpdaterThread();
@@ -123,22 +180,49 @@ ContentManager::ContentManager(Library* library)
 
     connect(&m_watcher, &QFileSystemWatcher::directoryChanged,
             this, &ContentManager::asyncUpdateLibraryFromDir);
+
+    loadBookUpdates();
+}
+
+ContentManager::~ContentManager()
+{
+    m_stopDownloadVerification = true;
+    m_downloadVerificationPool.waitForDone();
 }
 
 void ContentManager::updateModel()
 {
     const auto bookIds = getBookIds();
-    BookInfoList bookList;
-    QStringList keys = {"title", "tags", "date", "id", "size", "description", "favicon"};
-    for (auto bookId : bookIds) {
-        auto mp = getBookInfos(bookId, keys);
-        bookList.append(mp);
+    BookRecordList bookList;
+    bookList.reserve(bookIds.size());
+    for (const auto& bookId : bookIds) {
+        bookList.append(getBookRecord(bookId));
     }
 
     const DownloadManager& downloadMgr = *this;
     managerModel->setBooksData(bookList, downloadMgr);
 }
 
+// Adds the rows of the books from a batch of the catalog without rebuilding
+// the whole model
+void ContentManager::addRemoteBooksToModel(const QStringList& bookIds)
+{
+    BookRecordList bookList;
+    bookList.reserve(bookIds.size());
+    for (const auto& bookId : bookIds) {
+        bookList.append(getBookRecord(bookId));
+    }
+
+    const DownloadManager& downloadMgr = *this;
+    managerModel->addBooks(bookList, downloadMgr);
+}
+
+void ContentManager::updateModelRow(const QString& bookId)
+{
+    const DownloadManager& downloadMgr = *this;
+    managerModel->updateBook(getBookRecord(bookId), downloadMgr);
+}
+
 void ContentManager::onCustomContextMenu(const QPoint &point)
 {
     QModelIndex index = mp_view->getView()->indexAt(point);
@@ -154,6 +238,7 @@ void ContentManager::onCustomContextMenu(const QPoint &point)
     QAction menuPauseBook(gt("pause-download"), this);
     QAction menuResumeBook(gt("resume-download"), this);
     QAction menuCancelBook(gt("cancel-download"), this);
+    QAction menuDownloadBookFirst(gt("download-book-first"), this);
     QAction menuOpenFolder(gt("open-folder"), this);
     QAction menuPreviewBook(gt("preview-book-in-web-browser"), this);
 
@@ -171,6 +256,11 @@ void ContentManager::onCustomContextMenu(const QPoint &point)
         if ( getDownloadState(id)->getStatus() == DownloadState::DOWNLOADING ) {
             contextMenu.addAction(&menuPauseBook);
             contextMenu.addAction(&menuCancelBook);
+        } else if ( isQueued(id) ) {
+            if ( getSettingsManager()->getDownloadQueueOrder() == "priority" ) {
+                contextMenu.addAction(&menuDownloadBookFirst);
+            }
+            contextMenu.addAction(&menuCancelBook);
         }
         contextMenu.addAction(&menuPreviewBook);
         break;
@@ -218,6 +308,9 @@ void ContentManager::onCustomContextMenu(const QPoint &point)
     connect(&menuResumeBook, &QAction::triggered, [=]() {
         resumeBook(id, index);
     });
+    connect(&menuDownloadBookFirst, &QAction::triggered, [=]() {
+        setDownloadPriority(id, getHighestDownloadPriority() + 1);
+    });
     connect(&menuPreviewBook, &QAction::triggered, [=]() {
         openBookPreview(id);
     });
@@ -309,66 +402,42 @@ QString getFaviconUrl(const kiwix::Book& b)
     return QString::fromStdString(url);
 }
 
-QByteArray getFaviconData(const kiwix::Book& b)
+BookRecord makeBookRecord(const kiwix::Book& b)
 {
-    QByteArray qdata;
-    try {
-        // Try to obtain favicons only from local books (otherwise
-        // kiwix::Book::Illustration::getData() attempts to download the image
-        // on its own, whereas we want that operation to be performed
-        // asynchronously by ThumbnailDownloader).
-        if ( b.isPathValid() ) {
-            const auto illustration = b.getIllustration(48);
-            const std::string data = illustration->getData();
-
-            qdata = QByteArray::fromRawData(data.data(), data.size());
-            qdata.detach(); // deep copy
-        }
-    } catch ( ... ) {
-        return QByteArray();
-    }
-
-    return qdata;
-}
-
-QVariant getFaviconDataOrUrl(const kiwix::Book& b)
-{
-    const QByteArray data = getFaviconData(b);
-    return !data.isNull() ? QVariant(data) : QVariant(getFaviconUrl(b));
-}
-
-QVariant getBookAttribute(const kiwix::Book& b, const QString& a)
-{
-    if ( a == "id" )          return QString::fromStdString(b.getId());
-    if ( a == "path" )        return QString::fromStdString(b.getPath());
-    if ( a == "title" )       return QString::fromStdString(b.getTitle());
-    if ( a == "description" ) return QString::fromStdString(b.getDescription());
-    if ( a == "date" )        return QString::fromStdString(b.getDate());
-    if ( a == "url" )         return QString::fromStdString(b.getUrl());
-    if ( a == "name" )        return QString::fromStdString(b.getName());
-    if ( a == "favicon")      return getFaviconDataOrUrl(b);
-    if ( a == "size" )        return QString::number(b.getSize());
-    if ( a == "tags" )        return getBookTags(b);
-
-    return QVariant();
+    BookRecord r;
+    r.id          = QString::fromStdString(b.getId());
+    r.title       = QString::fromStdString(b.getTitle());
+    r.titleSortKey = r.title.toCaseFolded();
+    r.description = QString::fromStdString(b.getDescription());
+    r.date        = QString::fromStdString(b.getDate());
+    r.tags        = getBookTags(b);
+    r.size        = b.getSize();
+
+    // The favicon of a local book is loaded lazily by ContentManagerModel
+    // (only when it has to be displayed) so that refreshing the library
+    // doesn't touch every ZIM file.
+    r.isLocal     = b.isPathValid();
+    if ( !r.isLocal )
+        r.faviconUrl = getFaviconUrl(b);
+    return r;
 }
 
-ContentManager::BookState getStateOfLocalBook(const kiwix::Book& book)
+ContentManager::BookState getStateOfLocalBook(const kiwix::Book& book, const ZimIntegrityChecker& integrityChecker)
 {
     if ( !book.isPathValid() ) {
         return ContentManager::BookState::ERROR_MISSING_ZIM_FILE;
     }
 
-    // XXX: When a book is detected to be corrupted, information about that
-    // XXX: has to be recorded somewhere so that we can return
-    // XXX: ERROR_CORRUPTED_ZIM_FILE here
+    if ( integrityChecker.isCorrupted(QString::fromStdString(book.getId())) ) {
+        return ContentManager::BookState::ERROR_CORRUPTED_ZIM_FILE;
+    }
 
     return ContentManager::BookState::AVAILABLE_LOCALLY_AND_HEALTHY;
 }
 
 } // unnamed namespace
 
-ContentManager::BookInfo ContentManager::getBookInfos(QString id, const QStringList &keys)
+BookRecord ContentManager::getBookRecord(QString id)
 {
     const kiwix::Book* b = nullptr;
     try {
@@ -388,12 +457,7 @@ ContentManager::BookInfo ContentManager::getBookInfos(QString id, const QStringL
         } catch(...) {}
     }
 
-    BookInfo values;
-    for(auto& key: keys){
-        values.insert(key, b ? getBookAttribute(*b, key) : "");
-    }
-
-    return values;
+    return b ? makeBookRecord(*b) : BookRecord();
 }
 
 ContentManager::BookState ContentManager::getBookState(QString bookId)
@@ -408,7 +472,7 @@ ContentManager::BookState ContentManager::getBookState(QString bookId)
     try {
         const kiwix::Book& b = mp_library->getBookById(bookId);
         return b.getDownloadId().empty()
-             ? getStateOfLocalBook(b)
+             ? getStateOfLocalBook(b, m_zimIntegrityChecker)
              : BookState::DOWNLOADING;
     } catch (...) {}
 
@@ -423,6 +487,29 @@ ContentManager::BookState ContentManager::getBookState(QString bookId)
     return BookState::INVALID;
 }
 
+// Only the books added to the library (or whose file has moved) since the
+// previous call are passed to the checker. The files are examined in the
+// checker's thread.
+void ContentManager::checkLocalBooksIntegrity()
+{
+    QMap<QString, QString> localBookFiles;
+    QList<ZimIntegrityChecker::BookFile> bookFilesToCheck;
+    for (const auto& bookId : mp_library->getBookIds()) {
+        const kiwix::Book& b = mp_library->getBookById(bookId);
+        if ( b.getDownloadId().empty() && b.isPathValid() ) {
+            const auto path = QString::fromStdString(b.getPath());
+            localBookFiles.insert(bookId, path);
+            if ( m_integrityCheckedBookFiles.value(bookId) != path ) {
+                bookFilesToCheck.append({bookId, path});
+            }
+        }
+    }
+    m_integrityCheckedBookFiles = localBookFiles;
+    if ( !bookFilesToCheck.isEmpty() ) {
+        m_zimIntegrityChecker.checkBooks(bookFilesToCheck);
+    }
+}
+
 void ContentManager::openBookWithIndex(const QModelIndex &index)
 {
     auto bookNode = static_cast<Node*>(index.internalPointer());
@@ -488,7 +575,7 @@ void ContentManager::downloadDisappeared(QString bookId)
     }
 
     bCopy.setDownloadId("");
-    mp_library->getKiwixLibrary()->addOrUpdateBook(bCopy);
+    mp_library->addOrUpdateBook(bCopy);
     mp_library->save();
     emit(mp_library->booksChanged());
 }
@@ -502,7 +589,7 @@ void ContentManager::downloadCompleted(QString bookId, QString path)
     bCopy.setPathValid(true);
     // removing book url so that download link in kiwix-serve is not displayed.
     bCopy.setUrl("");
-    mp_library->getKiwixLibrary()->addOrUpdateBook(bCopy);
+    mp_library->addOrUpdateBook(bCopy);
     mp_library->save();
     mp_library->bookmarksChanged();
     if (!m_local) {
@@ -512,13 +599,69 @@ void ContentManager::downloadCompleted(QString bookId, QString path)
     }
 }
 
+// The completed download is added to the library only after the ZIM file has
+// been verified (in a worker thread, since that means reading the whole file)
+void ContentManager::verifyDownload(QString bookId, QString path)
+{
+    const auto downloadState = DownloadManager::getDownloadState(bookId);
+    downloadState->markAsVerifying();
+    managerModel->updateDownload(bookId);
+
+    const QString bookPath = QDir::toNativeSeparators(path);
+    (void) QtConcurrent::run(&m_downloadVerificationPool, [=]() {
+        int reportedPercentage = 0;
+        const auto reportProgress = [&](double share) {
+            const int percentage = int(100 * share);
+            if ( percentage == reportedPercentage )
+                return;
+            reportedPercentage = percentage;
+            QMetaObject::invokeMethod(this, [=]() {
+                downloadState->progress = percentage;
+                managerModel->updateDownload(bookId);
+            }, Qt::QueuedConnection);
+        };
+
+        const auto result = ZimIntegrityChecker::checkZimFile(bookPath, 0, m_stopDownloadVerification, reportProgress);
+        if ( result == ZimIntegrityChecker::CheckResult::INTERRUPTED )
+            return; // the application is exiting
+
+        const bool healthy = (result == ZimIntegrityChecker::CheckResult::HEALTHY);
+        QMetaObject::invokeMethod(this, [=]() {
+            downloadVerified(bookId, bookPath, healthy);
+        }, Qt::QueuedConnection);
+    });
+}
+
+// A corrupted download is added to the library anyway (it is reported as
+// such and can be deleted from there)
+void ContentManager::downloadVerified(QString bookId, QString path, bool healthy)
+{
+    m_zimIntegrityChecker.setResult(bookId, path, !healthy);
+    downloadCompleted(bookId, path);
+    if ( healthy ) {
+        if ( m_bookUpdates.contains(bookId) ) {
+            replaceUpdatedBook(bookId);
+        }
+    } else {
+        // the outdated book (if any) is kept
+        if ( m_bookUpdates.remove(bookId) ) {
+            saveBookUpdates();
+        }
+        auto text = gt("download-verification-failed-text");
+        text = text.replace("{{ZIM}}", QString::fromStdString(mp_library->getBookById(bookId).getTitle()));
+        showErrorBox(KiwixAppError(gt("download-verification-failed"), text), mp_view);
+    }
+}
+
 void ContentManager::updateDownload(QString bookId, const DownloadInfo& downloadInfo)
 {
     const auto downloadState = DownloadManager::getDownloadState(bookId);
     if ( downloadState ) {
         const auto downloadPath = downloadInfo["path"].toString();
-        if ( downloadInfo["status"].toString() == "completed" ) {
-            downloadCompleted(bookId, downloadPath);
+        if ( downloadState->getStatus() == DownloadState::VERIFYING ) {
+            // a late update
+        } else if ( downloadInfo["status"].toString() == "completed" ) {
+            verifyDownload(bookId, downloadPath);
         } else {
             mp_library->updateBookBeingDownloaded(bookId, downloadPath);
             downloadState->update(downloadInfo);
@@ -534,26 +677,222 @@ void ContentManager::handleError(QString errSummary, QString errDetails)
 
 void ContentManager::downloadBook(const QString &id)
 {
-    kiwix::Book book = getRemoteOrLocalBook(id);
-    const auto downloadPath = getSettingsManager()->getDownloadDir();
-
+    const kiwix::Book book = getRemoteOrLocalBook(id);
     try {
-        DownloadManager::checkThatBookCanBeDownloaded(book, downloadPath);
+        queueBookDownload(book);
     } catch ( const KiwixAppError& err ) {
         showErrorBox(err, mp_view);
-        return;
     }
+}
+
+// Throws a KiwixAppError if the book can't be downloaded
+void ContentManager::queueBookDownload(const kiwix::Book& book)
+{
+    const auto downloadPath = getSettingsManager()->getDownloadDir();
+    const auto queuedDownloadsSize = DownloadManager::getQueuedDownloadsSize(downloadPath);
+    DownloadManager::checkThatBookCanBeDownloaded(book, downloadPath, queuedDownloadsSize);
 
     mp_library->addBookBeingDownloaded(book, downloadPath);
     mp_library->save();
 
-    DownloadManager::addRequest(DownloadState::START, id);
+    const auto id = QString::fromStdString(book.getId());
+    DownloadManager::scheduleDownload(id);
     const auto downloadState = DownloadManager::getDownloadState(id);
     managerModel->setDownloadState(id, downloadState);
 }
 
+// Downloads the newer versions (same name and flavour, more recent date) of
+// the local books available in the remote catalog. The catalog is queried
+// for every book name (see handleBooksByName()) since the remote library
+// may hold only a part of the catalog. Every local book is replaced by its
+// newer version only after the latter has been downloaded and verified (see
+// replaceUpdatedBook()).
+void ContentManager::updateAllBooks()
+{
+    if ( !m_booksAwaitingUpdateCheck.isEmpty() )
+        return; // the previous check is still running
+
+    m_foundBookUpdates.clear();
+    m_bookUpdateFailures.clear();
+    m_booksAwaitingUpdateCheck = findUpdatableBooks();
+    if ( m_booksAwaitingUpdateCheck.isEmpty() ) {
+        showInfoBox(gt("update-all-books"), gt("no-book-updates-found"), mp_view);
+        return;
+    }
+
+    emit(pendingRequest(true));
+    for (const auto& name : m_booksAwaitingUpdateCheck.keys()) {
+        m_remoteLibraryManager.getBooksByName(name);
+    }
+}
+
+// Maps the names of the local books that can be updated to their ids
+QMap<QString, QStringList> ContentManager::findUpdatableBooks()
+{
+    QMap<QString, QStringList> updatableBooks;
+    const auto booksBeingUpdated = m_bookUpdates.values();
+    for (const auto& localBookId : mp_library->getBookIds()) {
+        const kiwix::Book& localBook = mp_library->getBookById(localBookId);
+        if ( localBook.getName().empty()
+          || !localBook.getDownloadId().empty()
+          || !localBook.isPathValid()
+          || booksBeingUpdated.contains(localBookId) ) {
+            continue;
+        }
+        updatableBooks[QString::fromStdString(localBook.getName())].append(localBookId);
+    }
+    return updatableBooks;
+}
+
+// Looks for the newest versions of the local books named name among the
+// books of opdsFeed. The downloads are queued once all the names have been
+// checked.
+void ContentManager::handleBooksByName(const QString& name, const QByteArray& opdsFeed, const QString& errorString)
+{
+    if ( !m_booksAwaitingUpdateCheck.contains(name) )
+        return; // not requested by the current check
+
+    const auto localBookIds = m_booksAwaitingUpdateCheck.take(name);
+    const auto remoteLibrary = kiwix::Library::create();
+    if ( !opdsFeed.isNull() ) {
+        kiwix::Manager manager(remoteLibrary);
+        manager.readOpds(opdsFeed.toStdString(), getRemoteLibraryUrl().toStdString());
+    }
+
+    for (const auto& localBookId : localBookIds) {
+        try {
+            const kiwix::Book& localBook = mp_library->getBookById(localBookId);
+            if ( opdsFeed.isNull() ) {
+                m_bookUpdateFailures.append(QString::fromStdString(localBook.getTitle()) + ": " + errorString);
+                continue;
+            }
+            const kiwix::Book* newestBook = findNewestVersion(localBook, *remoteLibrary);
+            if ( newestBook ) {
+                m_foundBookUpdates.append(qMakePair(*newestBook, localBookId));
+            }
+        } catch ( const std::out_of_range& ) {
+            // the local book has been removed in the meantime
+        }
+    }
+
+    if ( m_booksAwaitingUpdateCheck.isEmpty() ) {
+        emit(pendingRequest(false));
+        queueBookUpdates();
+    }
+}
+
+// Returns the most recent version of localBook found in remoteLibrary
+// (nullptr if there is none)
+const kiwix::Book* ContentManager::findNewestVersion(const kiwix::Book& localBook, const kiwix::Library& remoteLibrary) const
+{
+    const kiwix::Book* newestBook = nullptr;
+    const auto filter = kiwix::Filter().name(localBook.getName());
+    for (const auto& remoteBookId : remoteLibrary.filter(filter)) {
+        const kiwix::Book& remoteBook = remoteLibrary.getBookById(remoteBookId);
+        if ( remoteBook.getFlavour() != localBook.getFlavour() || remoteBook.getUrl().empty() )
+            continue;
+
+        // dates are in the YYYY-MM-DD format
+        const auto& newestDate = newestBook ? newestBook->getDate() : localBook.getDate();
+        if ( remoteBook.getDate() > newestDate ) {
+            newestBook = &remoteBook;
+        }
+    }
+    return newestBook;
+}
+
+// Queues the downloads of the book updates found. The books that can't be
+// downloaded are reported all at once instead of stopping the batch.
+void ContentManager::queueBookUpdates()
+{
+    int updateCount = 0;
+    const auto localBookIds = mp_library->getBookIds();
+    for (const auto& bookUpdate : m_foundBookUpdates) {
+        const kiwix::Book& newBook = bookUpdate.first;
+        const auto newBookId = QString::fromStdString(newBook.getId());
+        // the newer version may have been downloaded already
+        if ( localBookIds.contains(newBookId) )
+            continue;
+
+        try {
+            queueBookDownload(newBook);
+        } catch ( const KiwixAppError& err ) {
+            m_bookUpdateFailures.append(QString::fromStdString(newBook.getTitle()) + ": " + err.details());
+            continue;
+        }
+        m_bookUpdates.insert(newBookId, bookUpdate.second);
+        ++updateCount;
+    }
+    m_foundBookUpdates.clear();
+    saveBookUpdates();
+
+    QString text;
+    if ( updateCount > 0 ) {
+        text = gt("book-updates-queued");
+        text = text.replace("{{COUNT}}", QString::number(updateCount));
+    }
+    if ( !m_bookUpdateFailures.isEmpty() ) {
+        if ( !text.isEmpty() )
+            text += "\n\n";
+        text += gt("book-updates-failed") + "\n" + m_bookUpdateFailures.join("\n");
+        m_bookUpdateFailures.clear();
+        showErrorBox(KiwixAppError(gt("update-all-books"), text), mp_view);
+    } else if ( updateCount > 0 ) {
+        showInfoBox(gt("update-all-books"), text, mp_view);
+    } else {
+        showInfoBox(gt("update-all-books"), gt("no-book-updates-found"), mp_view);
+    }
+}
+
+// Replaces the local book updated by bookId with that book. The bookmarks are
+// moved to the new book before the old one is erased, hence the library never
+// refers to a missing or incomplete file.
+void ContentManager::replaceUpdatedBook(QString bookId)
+{
+    const QString oldBookId = m_bookUpdates.take(bookId);
+    saveBookUpdates();
+    try {
+        mp_library->getBookById(oldBookId);
+    } catch ( const std::out_of_range& ) {
+        return; // the old book has been removed in the meantime
+    }
+
+    mp_library->moveBookmarks(oldBookId, mp_library->getBookById(bookId));
+    if ( mp_library->getBookFilePath(oldBookId) == mp_library->getBookFilePath(bookId) ) {
+        // The old file has been overwritten by the new one
+        mp_library->removeBookFromLibraryById(oldBookId);
+        mp_library->save();
+        if (m_local) {
+            emit(bookRemoved(oldBookId));
+        } else {
+            emit(oneBookChanged(oldBookId));
+        }
+        emit(booksChanged());
+        return;
+    }
+    reallyEraseBook(oldBookId, shouldMoveFilesToTrash());
+}
+
+void ContentManager::loadBookUpdates()
+{
+    const QSettings settings(getBookUpdatesPath(), QSettings::IniFormat);
+    for (const auto& bookId : settings.childKeys()) {
+        m_bookUpdates.insert(bookId, settings.value(bookId).toString());
+    }
+}
+
+void ContentManager::saveBookUpdates() const
+{
+    QSettings settings(getBookUpdatesPath(), QSettings::IniFormat);
+    settings.clear();
+    for (auto it = m_bookUpdates.begin(); it != m_bookUpdates.end(); ++it) {
+        settings.setValue(it.key(), it.value());
+    }
+}
+
 // This function is called asynchronously in a worker thread processing all
-// download operations. The call is initiated in downloadBook().
+// download operations. The call is initiated by the download scheduler
+// (see DownloadManager::scheduleDownload()).
 void ContentManager::startDownload(QString id)
 {
     kiwix::Book book = getRemoteOrLocalBook(id);
@@ -577,6 +916,9 @@ void ContentManager::startDownload(QString id)
         downloadId = DownloadManager::startDownload(book, downloadPath);
     } catch ( const KiwixAppError& err ) {
         emit error(err.summary(), err.details());
+        QMetaObject::invokeMethod(this, [=]() {
+            downloadFailedToStart(id);
+        }, Qt::QueuedConnection);
         return;
     }
 
@@ -586,6 +928,36 @@ void ContentManager::startDownload(QString id)
     emit(oneBookChanged(id));
 }
 
+// A queued download that couldn't be started is dropped, otherwise it would
+// keep taking an active download slot
+void ContentManager::downloadFailedToStart(const QString& id)
+{
+    removeDownload(id);
+    if ( m_bookUpdates.remove(id) ) {
+        saveBookUpdates();
+    }
+
+    mp_library->removeBookFromLibraryById(id);
+    mp_library->save();
+    emit(oneBookChanged(id));
+    emit(downloadsChanged());
+    DownloadManager::startQueuedDownloads();
+}
+
+bool ContentManager::downloadsAreBeingWatched() const
+{
+    return mp_view->isVisible() && !mp_view->window()->isMinimized();
+}
+
+// This function is called in the download updater thread
+void ContentManager::setDownloadId(QString bookId, std::string downloadId)
+{
+    kiwix::Book book = mp_library->getBookById(bookId);
+    book.setDownloadId(downloadId);
+    mp_library->addBookToLibrary(book);
+    mp_library->save();
+}
+
 const kiwix::Book& ContentManager::getRemoteOrLocalBook(const QString &id)
 {
     try {
@@ -664,11 +1036,7 @@ void ContentManager::reallyEraseBook(const QString& id, bool moveToTrash)
 void ContentManager::eraseBook(const QString& id)
 {
     auto text = gt("delete-book-text");
-#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
-    const auto moveToTrash = getSettingsManager()->getMoveToTrash();
-#else
-    const auto moveToTrash = false; // we do not support move to trash functionality for qt versions below 5.15
-#endif
+    const auto moveToTrash = shouldMoveFilesToTrash();
     if (moveToTrash) {
         text += formatText(gt("move-files-to-trash-text"));
     } else {
@@ -688,7 +1056,7 @@ void ContentManager::pauseBook(const QString& id, QModelIndex index)
 
 void ContentManager::resumeBook(const QString& id, QModelIndex index)
 {
-    DownloadManager::addRequest(DownloadState::RESUME, id);
+    DownloadManager::resumeDownloadAtUserRequest(id);
     managerModel->triggerDataUpdateAt(index);
 }
 
@@ -697,13 +1065,20 @@ void ContentManager::cancelBook(const QString& id)
     auto text = gt("cancel-download-text");
     text = text.replace("{{ZIM}}", QString::fromStdString(mp_library->getBookById(id).getTitle()));
     showConfirmBox(gt("cancel-download"), text, mp_view, [=]() {
-        DownloadManager::addRequest(DownloadState::CANCEL, id);
+        if ( DownloadManager::cancelQueuedDownload(id) ) {
+            downloadWasCancelled(id);
+        } else {
+            DownloadManager::addRequest(DownloadState::CANCEL, id);
+        }
     });
 }
 
 void ContentManager::downloadWasCancelled(const QString& id)
 {
     removeDownload(id);
+    if ( m_bookUpdates.remove(id) ) {
+        saveBookUpdates();
+    }
 
     // incompleted downloaded file should be perma deleted
     eraseBookFilesFromComputer(mp_library->getBookFilePath(id), false);
@@ -765,21 +1140,83 @@ void ContentManager::updateLibrary() {
     }
     try {
         emit(pendingRequest(true));
-        m_remoteLibraryManager.doUpdate(m_currentLanguage, m_categoryFilter);
+        {
+            QMutexLocker locker(&remoteLibraryLocker);
+            mp_remoteLibrary = kiwix::Library::create();
+            ++m_remoteLibraryGeneration;
+        }
+        m_remotePageStart = 0;
+        m_remotePageRequestPending = true;
+        m_moreRemotePagesAvailable = false;
+        m_remoteLibraryManager.doUpdate(m_currentLanguage, m_categoryFilter, m_searchQuery.trimmed(), m_remotePageStart);
     } catch (std::runtime_error&) {}
 }
 
-void ContentManager::updateRemoteLibrary(const QString& content) {
+bool ContentManager::canFetchMoreBooks() const
+{
+    return !m_local && !m_remotePageRequestPending && m_moreRemotePagesAvailable;
+}
+
+// Requests the next page of the catalog. The books are added to the remote
+// library (and the model) as they arrive.
+void ContentManager::fetchMoreBooks()
+{
+    if ( !canFetchMoreBooks() )
+        return;
+
+    m_remotePageStart += OpdsRequestManager::CATALOG_PAGE_SIZE;
+    m_remotePageRequestPending = true;
+    m_remoteLibraryManager.doUpdate(m_currentLanguage, m_categoryFilter, m_searchQuery.trimmed(), m_remotePageStart);
+}
+
+// Adds a batch of books received from the catalog to the remote library and
+// to the model. Batches belonging to a superseded catalog request are dropped.
+void ContentManager::updateRemoteLibrary(const QByteArray& opdsFeed) {
+    const int generation = m_remoteLibraryGeneration;
+    const kiwix::Filter filter = getBooksFilter();
     (void) QtConcurrent::run([=]() {
+        const auto batchLibrary = kiwix::Library::create();
+        kiwix::Manager manager(batchLibrary);
+        manager.readOpds(opdsFeed.toStdString(), getRemoteLibraryUrl().toStdString());
+        QStringList shownBookIds;
+        for (const auto& bookId : batchLibrary->filter(filter)) {
+            shownBookIds.append(QString::fromStdString(bookId));
+        }
+
         QMutexLocker locker(&remoteLibraryLocker);
-        mp_remoteLibrary = kiwix::Library::create();
-        kiwix::Manager manager(mp_remoteLibrary);
-        manager.readOpds(content.toStdString(), getRemoteLibraryUrl().toStdString());
-        emit(this->booksChanged());
+        if (generation != m_remoteLibraryGeneration)
+            return;
+        for (const auto& bookId : batchLibrary->getBooksIds()) {
+            mp_remoteLibrary->addBook(batchLibrary->getBookById(bookId));
+        }
+        locker.unlock();
+        QMetaObject::invokeMethod(this, [=]() {
+            if (!m_local && generation == m_remoteLibraryGeneration)
+                addRemoteBooksToModel(shownBookIds);
+        }, Qt::QueuedConnection);
         emit(this->pendingRequest(false));
     });
 }
 
+// Replaces the remote library with the books of opdsFeed (used when the first
+// page of the catalog shown from the cache turned out to be outdated). The
+// library is swapped and the paging restarted in the same step as the
+// generation bump, so that only the batches of the cached page still being
+// parsed are dropped.
+void ContentManager::replaceRemoteLibrary(const QByteArray& opdsFeed) {
+    const auto newRemoteLibrary = kiwix::Library::create();
+    kiwix::Manager manager(newRemoteLibrary);
+    manager.readOpds(opdsFeed.toStdString(), getRemoteLibraryUrl().toStdString());
+    {
+        QMutexLocker locker(&remoteLibraryLocker);
+        ++m_remoteLibraryGeneration;
+        mp_remoteLibrary = newRemoteLibrary;
+        m_remotePageStart = 0;
+        m_moreRemotePagesAvailable = false;
+    }
+    emit(booksChanged());
+}
+
 void ContentManager::updateLanguages(const QString& content) {
     auto languages = kiwix::readLanguagesFromFeed(content.toStdString());
     LanguageList tempLanguages;
@@ -805,10 +1242,27 @@ void ContentManager::updateCategories(const QString& content) {;
 void ContentManager::setSearch(const QString &search)
 {
     m_searchQuery = search;
-    emit(booksChanged());
+    m_searchDebounceTimer.start();
 }
 
-QStringList ContentManager::getBookIds()
+namespace
+{
+
+QStringList filterByIndex(const QStringList& bookIds, const QSet<QString>& matchingBookIds)
+{
+    QStringList result;
+    for (const auto& bookId : bookIds) {
+        if (matchingBookIds.contains(bookId))
+            result.append(bookId);
+    }
+    return result;
+}
+
+} // unnamed namespace
+
+// The filter of the books shown by the content manager (the text query
+// excepted)
+kiwix::Filter ContentManager::getBooksFilter() const
 {
     kiwix::Filter filter;
     std::vector<std::string> acceptTags, rejectTags;
@@ -819,66 +1273,143 @@ QStringList ContentManager::getBookIds()
 
     filter.acceptTags(acceptTags);
     filter.rejectTags(rejectTags);
-    filter.query(m_searchQuery.toStdString());
     if (m_currentLanguage != "")
         filter.lang(m_currentLanguage.toStdString());
     if (m_categoryFilter != "")
         filter.category(m_categoryFilter.toStdString());
-
     if (m_local) {
         filter.local(true);
         filter.valid(true);
-        return mp_library->listBookIds(filter, m_sortBy, m_sortOrderAsc);
     } else {
         filter.remote(true);
+    }
+    return filter;
+}
+
+QStringList ContentManager::getBookIds()
+{
+    const kiwix::Filter filter = getBooksFilter();
+    if (m_local) {
+        // The text query is answered by the search index of the library
+        // rather than by libkiwix so that filtering keeps up with typing.
+        const bool hasTextQuery = !m_searchQuery.trimmed().isEmpty();
+        // Sorting is performed by ContentManagerModel
+        const auto list = mp_library->listBookIds(filter, kiwix::UNSORTED, true);
+        if (!hasTextQuery)
+            return list;
+
+        return filterByIndex(list, mp_library->searchBooks(m_searchQuery));
+    } else {
         QMutexLocker locker(&remoteLibraryLocker);
         auto bookIds = mp_remoteLibrary->filter(filter);
-        mp_remoteLibrary->sort(bookIds, m_sortBy, m_sortOrderAsc);
         QStringList list;
         for(auto& bookId:bookIds) {
             list.append(QString::fromStdString(bookId));
         }
+        // The remote library only holds the books matching the text query
         return list;
     }
 }
 
-void ContentManager::setSortBy(const QString& sortBy, const bool sortOrderAsc)
-{
-    if (sortBy == "unsorted") {
-        m_sortBy = kiwix::UNSORTED;
-    } else if (sortBy == "title") {
-        m_sortBy = kiwix::TITLE;
-    } else if (sortBy == "size") {
-        m_sortBy = kiwix::SIZE;
-    } else if (sortBy == "date") {
-        m_sortBy = kiwix::DATE;
-    }
-    m_sortOrderAsc = sortOrderAsc;
-    emit(booksChanged());
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 // Directory monitoring stuff
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+QString getNormalizedDirPath(const QString& dir)
+{
+    return QDir::toNativeSeparators(QFileInfo(dir).absoluteFilePath());
+}
+
+} // unnamed namespace
+
+// Only the directories that weren't monitored yet are scanned
 void ContentManager::setMonitoredDirectories(QStringSet dirList)
 {
-    for (auto path : m_watcher.directories()) {
-        m_watcher.removePath(path);
+    QStringSet dirs;
+    for (const auto& dir : dirList) {
+        if (dir != "") {
+            dirs.insert(getNormalizedDirPath(dir));
+        }
     }
-    m_knownZimsInDir.clear();
+
+    QMutexLocker locker(&m_updateFromDirMutex);
+    for (const auto& dir : m_monitoredDirs - dirs) {
+        unwatchDir(dir);
+    }
+    const QStringSet newDirs = dirs - m_monitoredDirs;
+    m_monitoredDirs = dirs;
+    if (!newDirs.isEmpty()) {
+        m_savedKnownZimsInDir = readKnownZimFiles();
+        const auto libraryZimsByDir = mp_library->getLibraryZimsByDir();
+        for (const auto& dir : newDirs) {
+            // the directory may be already monitored as a subdirectory
+            if (!m_knownZimsInDir.contains(dir)) {
+                startMonitoringDir(dir, libraryZimsByDir.value(dir));
+            }
+        }
+    }
+    locker.unlock();
+
+    for (const auto& dir : newDirs) {
+        asyncUpdateLibraryFromDir(dir);
+    }
+}
+
+void ContentManager::startMonitoringDir(const QString& dirPath, const QStringSet& libraryZims)
+{
     MonitoredZimFileInfo libraryZimFileInfo;
     libraryZimFileInfo.status = MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY;
-    for (auto dir : dirList) {
-        if (dir != "") {
-            auto& zimsInDir = m_knownZimsInDir[dir];
-            for ( const auto& fname : mp_library->getLibraryZimsFromDir(dir) ) {
-                zimsInDir.insert(fname, libraryZimFileInfo);
-            }
-            m_watcher.addPath(dir);
-            asyncUpdateLibraryFromDir(dir);
+    auto& zimsInDir = m_knownZimsInDir[dirPath];
+    for ( const auto& fname : libraryZims ) {
+        zimsInDir.insert(fname, libraryZimFileInfo);
+    }
+    restoreKnownZimFiles(dirPath, zimsInDir);
+    m_unsavedKnownZimDirs.insert(dirPath);
+
+    // m_watcher belongs to the main thread
+    QMetaObject::invokeMethod(this, [=]() {
+        m_watcher.addPath(dirPath);
+    }, Qt::QueuedConnection);
+}
+
+// Returns true if books were removed from the library
+bool ContentManager::stopMonitoringDir(const QString& dirPath)
+{
+    bool libraryChanged = false;
+    for (const auto& subdir : m_subdirsOfMonitoredDir.take(dirPath)) {
+        libraryChanged |= stopMonitoringDir(subdir);
+    }
+
+    const QStringSet libraryZims = getLibraryZims(dirPath);
+    handleDisappearedZimFiles(dirPath, libraryZims);
+    libraryChanged |= !libraryZims.empty();
+    m_knownZimsInDir.remove(dirPath);
+    m_unsavedKnownZimDirs.insert(dirPath);
+
+    QMetaObject::invokeMethod(this, [=]() {
+        m_watcher.removePath(dirPath);
+    }, Qt::QueuedConnection);
+    return libraryChanged;
+}
+
+// Stops monitoring a directory that is no longer in the list of monitored
+// directories (unlike stopMonitoringDir() its books stay in the library)
+void ContentManager::unwatchDir(const QString& dirPath)
+{
+    for (const auto& subdir : m_subdirsOfMonitoredDir.take(dirPath)) {
+        if ( !m_monitoredDirs.contains(subdir) ) {
+            unwatchDir(subdir);
         }
     }
+    m_knownZimsInDir.remove(dirPath);
+    m_unsavedKnownZimDirs.insert(dirPath);
+
+    QMetaObject::invokeMethod(this, [=]() {
+        m_watcher.removePath(dirPath);
+    }, Qt::QueuedConnection);
 }
 
 void ContentManager::asyncUpdateLibraryFromDir(QString dir)
@@ -892,6 +1423,7 @@ void ContentManager::handleDisappearedZimFiles(const QString& dirPath, const QSt
 {
     const auto kiwixLib = mp_library->getKiwixLibrary();
     auto& zimsInDir = m_knownZimsInDir[dirPath];
+    m_unsavedKnownZimDirs.insert(dirPath);
     for (const auto& file : fileNames) {
         const auto bookPath = QDir::toNativeSeparators(dirPath + "/" + file);
         try {
@@ -909,18 +1441,58 @@ void ContentManager::handleDisappearedZimFiles(const QString& dirPath, const QSt
     }
 }
 
-size_t ContentManager::handleNewZimFiles(const QString& dirPath, const QStringSet& fileNames)
+namespace
 {
-    size_t countOfSuccessfullyAddedZims = 0;
-    for (const auto& file : fileNames) {
-        const bool addedToLib = handleZimFileInMonitoredDirLogged(dirPath, file);
-        countOfSuccessfullyAddedZims += addedToLib;
-    }
-    return countOfSuccessfullyAddedZims;
+
+// Opening too many files on the same (possibly slow, e.g. USB or network)
+// device at once only makes the disk seek back and forth.
+const int MAX_CONCURRENT_ZIM_FILE_READS_PER_DEVICE = 2;
+
+// Size of the fixed header at the start of every ZIM file
+const qint64 ZIM_HEADER_SIZE = 80;
+
+QString getKnownZimFilesPath()
+{
+    return getDataDirectory() + "/monitored-zim-files.ini";
 }
 
-namespace
+quint64 getInode(const QString& path)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if ( stat(QFile::encodeName(path).constData(), &st) == 0 )
+        return st.st_ino;
+#else
+    Q_UNUSED(path);
+#endif
+    return 0;
+}
+
+// The header of a ZIM file contains its UUID and the offsets of its parts,
+// so it changes whenever the file is replaced with another ZIM file.
+QByteArray getHeaderChecksum(const QString& path)
+{
+    QFile file(path);
+    if ( !file.open(QIODevice::ReadOnly) )
+        return QByteArray();
+    return QCryptographicHash::hash(file.read(ZIM_HEADER_SIZE), QCryptographicHash::Sha1).toHex();
+}
+
+// Reads the metadata of the book from a ZIM file without touching our
+// library, so that this can be done for many files concurrently.
+std::shared_ptr<kiwix::Book> readBookFromZimFile(const QString& path)
 {
+    const auto tmpLibrary = kiwix::Library::create();
+    kiwix::Manager manager(tmpLibrary);
+    if ( !manager.addBookFromPath(path.toStdString()) )
+        return nullptr;
+
+    const auto bookIds = tmpLibrary->getBooksIds();
+    if ( bookIds.empty() )
+        return nullptr;
+
+    return std::make_shared<kiwix::Book>(tmpLibrary->getBookById(bookIds.front()));
+}
 
 #ifndef QT_NO_DEBUG
 
@@ -939,12 +1511,58 @@ const char* monitoredDirZimFileHandlingMsgs[] = {
 
 } // unnamed namespace
 
-bool ContentManager::handleZimFileInMonitoredDirLogged(QString dir, QString fileName)
+// Collects the files that have to be read in order to be added to the
+// library (see addNewZimFiles())
+void ContentManager::findNewZimFiles(const QString& dirPath, const QStringSet& fileNames, QList<NewZimFile>& newZimFiles)
 {
-    DBGOUT("ContentManager::handleZimFileInMonitoredDir(" << dir << ", " << fileName << ")");
-    const int status = handleZimFileInMonitoredDir(dir, fileName);
-    DBGOUT("\t" << monitoredDirZimFileHandlingMsgs[status]);
-    return status == MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY;
+    for (const auto& file : fileNames) {
+        const auto zfi = checkZimFileInMonitoredDir(dirPath, file);
+        if ( zfi.status == MonitoredZimFileInfo::PROCESS_NOW ) {
+            newZimFiles.append({dirPath, file, zfi});
+        } else {
+            DBGOUT("directory monitoring: " << dirPath << "/" << file << ": "
+                   << monitoredDirZimFileHandlingMsgs[zfi.status]);
+        }
+    }
+}
+
+// The ZIM files are opened and validated concurrently without holding
+// m_updateFromDirMutex (which is where most of the time is spent), the lock
+// is taken only to add them to the library in one go.
+void ContentManager::addNewZimFiles(const QList<NewZimFile>& newZimFiles, bool libraryChanged, bool knownZimsChanged)
+{
+    QStringList paths;
+    for (const auto& newZimFile : newZimFiles) {
+        paths.append(QDir::toNativeSeparators(newZimFile.dir + "/" + newZimFile.fileName));
+    }
+    const auto books = readZimFilesConcurrently(paths);
+
+    QMutexLocker locker(&m_updateFromDirMutex);
+    for (int i = 0; i < newZimFiles.size(); ++i) {
+        const auto& newZimFile = newZimFiles[i];
+        const auto dirIt = m_knownZimsInDir.constFind(newZimFile.dir);
+        if ( dirIt == m_knownZimsInDir.constEnd()
+          || dirIt->value(newZimFile.fileName).status == MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY ) {
+            // The directory is no longer monitored or the file has been
+            // added by another scan in the meantime
+            continue;
+        }
+
+        const int status = addZimFileInMonitoredDir(newZimFile.dir, newZimFile.fileName, newZimFile.info, books[i].get());
+        DBGOUT("directory monitoring: " << paths[i] << ": " << monitoredDirZimFileHandlingMsgs[status]);
+        libraryChanged |= (status == MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY);
+        knownZimsChanged = true;
+    }
+
+    if (libraryChanged) {
+        mp_library->save();
+        emit(booksChanged());
+    }
+    locker.unlock();
+
+    if (knownZimsChanged) {
+        saveKnownZimFiles();
+    }
 }
 
 bool ContentManager::MonitoredZimFileInfo::fileKeepsBeingModified() const
@@ -957,11 +1575,39 @@ bool ContentManager::MonitoredZimFileInfo::fileKeepsBeingModified() const
     return this->lastModified > now.addMSecs(-FILE_STABILITY_DURATION_MS);
 }
 
+// Only reads the file system metadata (the file isn't opened)
+void ContentManager::MonitoredZimFileInfo::readFileStat(const QString& path)
+{
+    const QFileInfo fileInfo(path);
+    this->lastModified = fileInfo.lastModified();
+    this->size = fileInfo.size();
+    this->inode = getInode(path);
+}
+
+void ContentManager::MonitoredZimFileInfo::readFingerprint(const QString& path)
+{
+    readFileStat(path);
+    this->headerChecksum = getHeaderChecksum(path);
+}
+
+bool ContentManager::MonitoredZimFileInfo::hasSameFileStat(const MonitoredZimFileInfo& other) const
+{
+    return this->lastModified == other.lastModified
+        && this->size == other.size
+        && this->inode == other.inode;
+}
+
+bool ContentManager::MonitoredZimFileInfo::hasSameFingerprint(const MonitoredZimFileInfo& other) const
+{
+    return hasSameFileStat(other)
+        && this->headerChecksum == other.headerChecksum;
+}
+
 void ContentManager::MonitoredZimFileInfo::updateStatus(const MonitoredZimFileInfo& prevInfo)
 {
     Q_ASSERT(prevInfo.status != ADDED_TO_THE_LIBRARY);
 
-    if ( this->lastModified == prevInfo.lastModified ) {
+    if ( this->hasSameFingerprint(prevInfo) ) {
         this->status = UNCHANGED_KNOWN_BAD_ZIM_FILE;
     } else if ( prevInfo.status == PROCESS_LATER ) {
         this->status = DEFERRED_PROCESSING_ALREADY_PENDING;
@@ -977,40 +1623,94 @@ ContentManager::MonitoredZimFileInfo ContentManager::getMonitoredZimFileInfo(QSt
     const auto bookPath = QDir::toNativeSeparators(dir + "/" + fileName);
 
     MonitoredZimFileInfo zimFileInfo;
-
-    zimFileInfo.lastModified = QFileInfo(bookPath).lastModified();
+    zimFileInfo.readFileStat(bookPath);
 
     const auto& zimsInDir = m_knownZimsInDir[dir];
     const auto fileInfoEntry = zimsInDir.constFind(fileName);
-    if ( fileInfoEntry != zimsInDir.constEnd() ) {
+    const bool knownFile = fileInfoEntry != zimsInDir.constEnd();
+
+    // A known file (in particular a bad one) is opened again only if its
+    // size, modification time or inode have changed
+    if ( knownFile && zimFileInfo.hasSameFileStat(fileInfoEntry.value()) ) {
+        zimFileInfo.headerChecksum = fileInfoEntry->headerChecksum;
+    } else {
+        zimFileInfo.headerChecksum = getHeaderChecksum(bookPath);
+    }
+
+    if ( knownFile ) {
         zimFileInfo.updateStatus(fileInfoEntry.value());
     }
 
     return zimFileInfo;
 }
 
-int ContentManager::handleZimFileInMonitoredDir(QString dir, QString fileName)
+// Finds out what has to be done about the file. If the status of the
+// returned info is PROCESS_NOW the caller must read the ZIM file and pass
+// the result to addZimFileInMonitoredDir().
+ContentManager::MonitoredZimFileInfo ContentManager::checkZimFileInMonitoredDir(QString dir, QString fileName)
 {
     const auto bookPath = QDir::toNativeSeparators(dir + "/" + fileName);
 
+    MonitoredZimFileInfo zfi;
     if ( mp_library->isBeingDownloadedByUs(bookPath) ) {
-        return MonitoredZimFileInfo::BEING_DOWNLOADED_BY_US;
+        zfi.status = MonitoredZimFileInfo::BEING_DOWNLOADED_BY_US;
+        return zfi;
     }
 
-    MonitoredZimFileInfo zfi = getMonitoredZimFileInfo(dir, fileName);
+    zfi = getMonitoredZimFileInfo(dir, fileName);
     if ( zfi.status == MonitoredZimFileInfo::PROCESS_LATER ) {
         deferHandlingOfZimFileInMonitoredDir(dir, fileName);
-    } else if ( zfi.status == MonitoredZimFileInfo::PROCESS_NOW ) {
-        kiwix::Manager manager(mp_library->getKiwixLibrary());
-        const bool addedToLib = manager.addBookFromPath(bookPath.toStdString());
-        zfi.status = addedToLib
-                   ? MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY
-                   : MonitoredZimFileInfo::COULD_NOT_BE_ADDED_TO_THE_LIBRARY;
-        m_knownZimsInDir[dir].insert(fileName, zfi);
     }
+    return zfi;
+}
+
+// book is the result of reading the ZIM file (nullptr if it is invalid)
+int ContentManager::addZimFileInMonitoredDir(QString dir, QString fileName, MonitoredZimFileInfo zfi, const kiwix::Book* book)
+{
+    if ( book ) {
+        mp_library->addBookToLibrary(*book);
+    }
+    zfi.status = book
+               ? MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY
+               : MonitoredZimFileInfo::COULD_NOT_BE_ADDED_TO_THE_LIBRARY;
+    m_knownZimsInDir[dir].insert(fileName, zfi);
+    m_unsavedKnownZimDirs.insert(dir);
     return zfi.status;
 }
 
+// Reads the ZIM files in parallel, limiting the number of files being read
+// simultaneously from the same device. The result is in the order of paths.
+ContentManager::BooksFromZimFiles ContentManager::readZimFilesConcurrently(const QStringList& paths)
+{
+    BooksFromZimFiles books(paths.size());
+
+    QMap<QByteArray, QVector<int>> filesByDevice;
+    for (int i = 0; i < paths.size(); ++i) {
+        filesByDevice[QStorageInfo(paths[i]).device()].append(i);
+    }
+
+    QList<QFuture<void>> readers;
+    for (const auto& fileIndices : filesByDevice) {
+        // The readers of a device take the next file from a shared counter.
+        // Each of them writes to its own elements of books only.
+        const auto nextFile = std::make_shared<QAtomicInt>(0);
+        const int readerCount = qMin(int(fileIndices.size()), MAX_CONCURRENT_ZIM_FILE_READS_PER_DEVICE);
+        for (int r = 0; r < readerCount; ++r) {
+            readers.append(QtConcurrent::run(&m_zimFileReaderPool, [nextFile, fileIndices, paths, &books]() {
+                for (int k = nextFile->fetchAndAddRelaxed(1); k < fileIndices.size(); k = nextFile->fetchAndAddRelaxed(1)) {
+                    const int i = fileIndices[k];
+                    books[i] = readBookFromZimFile(paths[i]);
+                }
+            }));
+        }
+    }
+
+    for (auto& reader : readers) {
+        reader.waitForFinished();
+    }
+    return books;
+}
+
 ContentManager::QStringSet ContentManager::getLibraryZims(QString dirPath) const
 {
     QStringSet zimFileNames;
@@ -1022,35 +1722,223 @@ ContentManager::QStringSet ContentManager::getLibraryZims(QString dirPath) const
     return zimFileNames;
 }
 
+// A change is reported only for the directory where it happened, so the
+// subdirectories of that directory are scanned only if they are new.
 void ContentManager::updateLibraryFromDir(QString dirPath)
 {
-    QMutexLocker locker(&m_updateFromDirMutex);
+    bool libraryChanged = false;
+    bool knownZimsChanged = false;
+    QList<NewZimFile> newZimFiles;
+    {
+        QMutexLocker locker(&m_updateFromDirMutex);
+        if ( !m_knownZimsInDir.contains(dirPath) )
+            return; // no longer monitored
+
+        // The library books are grouped by directory only if there are new
+        // subdirectories to be monitored
+        std::optional<QMap<QString, QStringSet>> libraryZimsByDir;
+        QStringList dirsToScan{dirPath};
+        while ( !dirsToScan.isEmpty() ) {
+            const QString dir = dirsToScan.takeLast();
+            const QStringSet newSubdirs = updateSubdirsOfMonitoredDir(dir, libraryZimsByDir, libraryChanged);
+            for (const auto& subdir : newSubdirs) {
+                dirsToScan.append(subdir);
+            }
+            knownZimsChanged |= updateZimFilesInMonitoredDir(dir, libraryChanged, newZimFiles);
+            knownZimsChanged |= !newSubdirs.empty();
+        }
+    }
+
+    addNewZimFiles(newZimFiles, libraryChanged, knownZimsChanged);
+}
+
+// Starts monitoring the new subdirectories of the directory (which are
+// returned so that they can be scanned) and stops monitoring the ones that
+// have disappeared.
+ContentManager::QStringSet ContentManager::updateSubdirsOfMonitoredDir(const QString& dirPath, std::optional<QMap<QString, QStringSet>>& libraryZimsByDir, bool& libraryChanged)
+{
+    QStringSet subdirs;
+    const auto filters = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks;
+    for (const auto& fileInfo : QDir(dirPath).entryInfoList(filters)) {
+        subdirs.insert(getNormalizedDirPath(fileInfo.absoluteFilePath()));
+    }
+
+    const QStringSet knownSubdirs = m_subdirsOfMonitoredDir.value(dirPath);
+    for (const auto& subdir : knownSubdirs - subdirs) {
+        libraryChanged |= stopMonitoringDir(subdir);
+    }
+
+    QStringSet newSubdirs;
+    for (const auto& subdir : subdirs - knownSubdirs) {
+        // Skip the monitored directories that happen to be nested
+        if ( !m_knownZimsInDir.contains(subdir) ) {
+            if ( !libraryZimsByDir ) {
+                libraryZimsByDir = mp_library->getLibraryZimsByDir();
+            }
+            startMonitoringDir(subdir, libraryZimsByDir->value(subdir));
+            newSubdirs.insert(subdir);
+        }
+    }
+    m_subdirsOfMonitoredDir[dirPath] = (knownSubdirs & subdirs) + newSubdirs;
+    return newSubdirs;
+}
+
+// Returns true if the saved state of the ZIM files in the directory has
+// changed. The files to be added to the library are appended to newZimFiles.
+bool ContentManager::updateZimFilesInMonitoredDir(const QString& dirPath, bool& libraryChanged, QList<NewZimFile>& newZimFiles)
+{
     const QDir dir(dirPath);
     const QStringSet zimsPresentInLib = getLibraryZims(dirPath);
 
     QStringSet zimsInDir;
-    for (const auto &file : dir.entryList({"*.zim"})) {
+    for (const auto &file : dir.entryList({"*.zim"}, QDir::Files)) {
         zimsInDir.insert(file);
     }
 
     const QStringSet zimsNotInLib = zimsInDir - zimsPresentInLib;
     const QStringSet removedZims = zimsPresentInLib - zimsInDir;
     handleDisappearedZimFiles(dirPath, removedZims);
-    const auto countOfAddedZims = handleNewZimFiles(dirPath, zimsNotInLib);
-    if (!removedZims.empty() || countOfAddedZims != 0) {
-        mp_library->save();
-        emit(booksChanged());
-    }
+    findNewZimFiles(dirPath, zimsNotInLib, newZimFiles);
+    libraryChanged |= !removedZims.empty();
+    return !removedZims.empty();
 }
 
 void ContentManager::handleZimFileInMonitoredDirDeferred(QString dir, QString fileName)
 {
-    QMutexLocker locker(&m_updateFromDirMutex);
     DBGOUT("ContentManager::handleZimFileInMonitoredDirDeferred(" << dir << ", " << fileName << ")");
-    m_knownZimsInDir[dir][fileName].status = MonitoredZimFileInfo::PROCESS_NOW;
-    if ( handleZimFileInMonitoredDirLogged(dir, fileName) ) {
-        mp_library->save();
-        emit(booksChanged());
+    (void) QtConcurrent::run([=]() {
+        QList<NewZimFile> newZimFiles;
+        {
+            QMutexLocker locker(&m_updateFromDirMutex);
+            if ( !m_knownZimsInDir.contains(dir) )
+                return; // no longer monitored
+
+            m_knownZimsInDir[dir][fileName].status = MonitoredZimFileInfo::PROCESS_NOW;
+            findNewZimFiles(dir, {fileName}, newZimFiles);
+        }
+        addNewZimFiles(newZimFiles, false, false);
+    });
+}
+
+// The statuses of the ZIM files in the monitored directories are saved along
+// with the fingerprints of the files, so that after a restart the files that
+// haven't changed aren't opened again (in particular the bad ones).
+void ContentManager::restoreKnownZimFiles(const QString& dirPath, ZimFileName2InfoMap& zimsInDir) const
+{
+    const auto savedZimsInDir = m_savedKnownZimsInDir.value(dirPath);
+    for (auto it = savedZimsInDir.begin(); it != savedZimsInDir.end(); ++it) {
+        // A book that was in the library but has been removed from it
+        // since then must be checked again
+        const bool inLibrary = zimsInDir.contains(it.key());
+        const auto status = it.value().status;
+        if ( status == MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY && inLibrary ) {
+            zimsInDir.insert(it.key(), it.value());
+        } else if ( status == MonitoredZimFileInfo::COULD_NOT_BE_ADDED_TO_THE_LIBRARY && !inLibrary ) {
+            zimsInDir.insert(it.key(), it.value());
+        }
+    }
+}
+
+// Reads the file statuses written by saveKnownZimFiles(), by directory
+QMap<QString, ContentManager::ZimFileName2InfoMap> ContentManager::readKnownZimFiles()
+{
+    QMap<QString, ZimFileName2InfoMap> knownZimsInDir;
+    QSettings settings(getKnownZimFilesPath(), QSettings::IniFormat);
+    for (const auto& group : settings.childGroups()) {
+        settings.beginGroup(group);
+        auto& zimsInDir = knownZimsInDir[settings.value("path").toString()];
+        const int fileCount = settings.beginReadArray("files");
+        for (int j = 0; j < fileCount; ++j) {
+            settings.setArrayIndex(j);
+            MonitoredZimFileInfo zfi;
+            zfi.status = MonitoredZimFileInfo::ZimFileStatus(settings.value("status").toInt());
+            zfi.lastModified = settings.value("lastModified").toDateTime();
+            zfi.size = settings.value("size", -1).toLongLong();
+            zfi.inode = settings.value("inode", 0).toULongLong();
+            zfi.headerChecksum = settings.value("headerChecksum").toByteArray();
+            zimsInDir.insert(settings.value("name").toString(), zfi);
+        }
+        settings.endArray();
+        settings.endGroup();
+    }
+    return knownZimsInDir;
+}
+
+// Only the directories whose files have changed since the last save are
+// written (each one in its own group). Must be called with
+// m_updateFromDirMutex unlocked: the files whose fingerprints are still
+// unknown are read without holding it.
+void ContentManager::saveKnownZimFiles()
+{
+    // Serializes the saves so that they are written in the order in which
+    // the directories were copied
+    QMutexLocker saveLocker(&m_knownZimFilesSaveMutex);
+
+    QMap<QString, std::optional<ZimFileName2InfoMap>> dirsToSave;
+    {
+        QMutexLocker locker(&m_updateFromDirMutex);
+        for (const auto& dir : m_unsavedKnownZimDirs) {
+            const auto dirIt = m_knownZimsInDir.constFind(dir);
+            if ( dirIt == m_knownZimsInDir.constEnd() ) {
+                dirsToSave.insert(dir, std::nullopt);
+            } else {
+                dirsToSave.insert(dir, dirIt.value());
+            }
+        }
+        m_unsavedKnownZimDirs.clear();
+    }
+
+    QMap<QString, ZimFileName2InfoMap> newFingerprints;
+    QSettings settings(getKnownZimFilesPath(), QSettings::IniFormat);
+    for (auto dirIt = dirsToSave.begin(); dirIt != dirsToSave.end(); ++dirIt) {
+        const QString group = QCryptographicHash::hash(dirIt.key().toUtf8(), QCryptographicHash::Sha1).toHex();
+        settings.remove(group);
+        if ( !dirIt.value() )
+            continue; // no longer monitored
+
+        settings.beginGroup(group);
+        settings.setValue("path", dirIt.key());
+        settings.beginWriteArray("files");
+        int fileIndex = 0;
+        for (auto it = dirIt.value()->begin(); it != dirIt.value()->end(); ++it) {
+            MonitoredZimFileInfo& zfi = it.value();
+            if ( zfi.status != MonitoredZimFileInfo::ADDED_TO_THE_LIBRARY
+              && zfi.status != MonitoredZimFileInfo::COULD_NOT_BE_ADDED_TO_THE_LIBRARY )
+                continue;
+
+            // The fingerprints of the books found in the library at startup
+            // are unknown until now
+            if ( zfi.size == -1 ) {
+                zfi.readFingerprint(QDir::toNativeSeparators(dirIt.key() + "/" + it.key()));
+                newFingerprints[dirIt.key()].insert(it.key(), zfi);
+            }
+            settings.setArrayIndex(fileIndex++);
+            settings.setValue("name", it.key());
+            settings.setValue("status", int(zfi.status));
+            settings.setValue("lastModified", zfi.lastModified);
+            settings.setValue("size", zfi.size);
+            settings.setValue("inode", zfi.inode);
+            settings.setValue("headerChecksum", zfi.headerChecksum);
+        }
+        settings.endArray();
+        settings.endGroup();
+    }
+
+    // The fingerprints are kept unless the files have been handled again in
+    // the meantime
+    QMutexLocker locker(&m_updateFromDirMutex);
+    for (auto dirIt = newFingerprints.begin(); dirIt != newFingerprints.end(); ++dirIt) {
+        const auto knownDirIt = m_knownZimsInDir.find(dirIt.key());
+        if ( knownDirIt == m_knownZimsInDir.end() )
+            continue;
+
+        for (auto it = dirIt.value().begin(); it != dirIt.value().end(); ++it) {
+            const auto fileIt = knownDirIt->find(it.key());
+            if ( fileIt != knownDirIt->end() && fileIt->size == -1
+              && fileIt->status == it.value().status ) {
+                *fileIt = it.value();
+            }
+        }
     }
 }
 
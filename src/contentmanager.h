@@ -2,12 +2,19 @@
 #define CONTENTMANAGER_H
 
 #include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
 #include "library.h"
 #include "contentmanagerview.h"
 #include "opdsrequestmanager.h"
 #include "contenttypefilter.h"
 #include "contentmanagermodel.h"
 #include "downloadmanagement.h"
+#include "zimintegritychecker.h"
 
 class ContentManager : public DownloadManager
 {
@@ -17,8 +24,6 @@ class ContentManager : public DownloadManager
 public: // types
     typedef QList<QPair<QString, QString>> LanguageList;
     typedef QList<QPair<QString, QString>> FilterList;
-    typedef ContentManagerModel::BookInfo     BookInfo;
-    typedef ContentManagerModel::BookInfoList BookInfoList;
     typedef Library::QStringSet QStringSet;
 
     enum class BookState
@@ -60,6 +65,7 @@ public: // types
 
 public: // functions
     ContentManager(Library* library);
+    ~ContentManager();
 
     ContentManagerView* getView() { return mp_view; }
     void setLocal(bool local);
@@ -72,6 +78,10 @@ public: // functions
 
     void setMonitoredDirectories(QStringSet dirList);
 
+    // Paging through the remote catalog
+    bool canFetchMoreBooks() const;
+    void fetchMoreBooks();
+
 signals:
     void filterParamsChanged();
     void booksChanged();
@@ -86,17 +96,18 @@ signals:
 
 public slots:
     QStringList getTranslations(const QStringList &keys);
-    BookInfo getBookInfos(QString id, const QStringList &keys);
+    BookRecord getBookRecord(QString id);
     BookState getBookState(QString id);
     void openBook(const QString& id);
     void openBookPreview(const QString& id);
     void downloadBook(const QString& id);
+    void updateAllBooks();
     void updateLibrary();
     void setSearch(const QString& search);
-    void setSortBy(const QString& sortBy, const bool sortOrderAsc);
     // eraseBook() asks for confirmation (reallyEraseBook() doesn't)
     void eraseBook(const QString& id);
-    void updateRemoteLibrary(const QString& content);
+    void updateRemoteLibrary(const QByteArray& opdsFeed);
+    void replaceRemoteLibrary(const QByteArray& opdsFeed);
     void updateLanguages(const QString& content);
     void updateCategories(const QString& content);
     void pauseBook(const QString& id, QModelIndex index);
@@ -137,32 +148,66 @@ private: // types
         };
 
         bool fileKeepsBeingModified() const;
+        void readFileStat(const QString& path);
+        void readFingerprint(const QString& path);
+        bool hasSameFileStat(const MonitoredZimFileInfo& other) const;
+        bool hasSameFingerprint(const MonitoredZimFileInfo& other) const;
         void updateStatus(const MonitoredZimFileInfo& prevInfo);
 
         ZimFileStatus status = PROCESS_NOW;
+
+        // Fingerprint of the file (size is -1 if it is not known)
         QDateTime lastModified;
+        qint64 size = -1;
+        quint64 inode = 0;
+        QByteArray headerChecksum;
     };
 
     typedef QMap<QString, MonitoredZimFileInfo> ZimFileName2InfoMap;
 
+    // A ZIM file found in a monitored directory that has to be read
+    struct NewZimFile
+    {
+        QString dir;
+        QString fileName;
+        MonitoredZimFileInfo info;
+    };
+
+    // Books read from ZIM files (nullptr for invalid files)
+    typedef std::vector<std::shared_ptr<kiwix::Book>> BooksFromZimFiles;
+
 private: // functions
+    kiwix::Filter getBooksFilter() const;
     QStringList getBookIds();
     // reallyEraseBook() doesn't ask for confirmation (unlike eraseBook())
     void reallyEraseBook(const QString& id, bool moveToTrash);
     void eraseBookFilesFromComputer(const std::string& bookPath, bool moveToTrash);
     void updateModel();
+    void updateModelRow(const QString& bookId);
+    void addRemoteBooksToModel(const QStringList& bookIds);
     void setCategories();
     void setLanguages();
     QStringSet getLibraryZims(QString dirPath) const;
     void asyncUpdateLibraryFromDir(QString dir);
     void updateLibraryFromDir(QString dir);
     void handleDisappearedZimFiles(const QString& dirPath, const QStringSet& fileNames);
-    size_t handleNewZimFiles(const QString& dirPath, const QStringSet& fileNames);
-    bool handleZimFileInMonitoredDirLogged(QString dirPath, QString fileName);
-    int handleZimFileInMonitoredDir(QString dirPath, QString fileName);
+    void findNewZimFiles(const QString& dirPath, const QStringSet& fileNames, QList<NewZimFile>& newZimFiles);
+    void addNewZimFiles(const QList<NewZimFile>& newZimFiles, bool libraryChanged, bool knownZimsChanged);
+    MonitoredZimFileInfo checkZimFileInMonitoredDir(QString dirPath, QString fileName);
+    int addZimFileInMonitoredDir(QString dirPath, QString fileName, MonitoredZimFileInfo zfi, const kiwix::Book* book);
+    BooksFromZimFiles readZimFilesConcurrently(const QStringList& paths);
     MonitoredZimFileInfo getMonitoredZimFileInfo(QString dir, QString fileName) const;
     void deferHandlingOfZimFileInMonitoredDir(QString dir, QString fileName);
     void handleZimFileInMonitoredDirDeferred(QString dirPath, QString fileName);
+    void checkLocalBooksIntegrity();
+    void startMonitoringDir(const QString& dirPath, const QStringSet& libraryZims);
+    bool stopMonitoringDir(const QString& dirPath);
+    void unwatchDir(const QString& dirPath);
+    QStringSet updateSubdirsOfMonitoredDir(const QString& dirPath, std::optional<QMap<QString, QStringSet>>& libraryZimsByDir, bool& libraryChanged);
+    bool updateZimFilesInMonitoredDir(const QString& dirPath, bool& libraryChanged, QList<NewZimFile>& newZimFiles);
+    static QMap<QString, ZimFileName2InfoMap> readKnownZimFiles();
+    void restoreKnownZimFiles(const QString& dirPath, ZimFileName2InfoMap& zimsInDir) const;
+    void saveKnownZimFiles();
     bool handleDisappearedBook(QString bookId);
 
     // Get the book with the specified id from
@@ -171,9 +216,22 @@ private: // functions
     QString getRemoteLibraryUrl() const;
 
     void startDownload(QString bookId) override;
+    void downloadFailedToStart(const QString& id);
+    bool downloadsAreBeingWatched() const override;
+    void setDownloadId(QString bookId, std::string downloadId) override;
     void removeDownload(QString bookId);
     void downloadDisappeared(QString bookId);
     void downloadCompleted(QString bookId, QString path);
+    void verifyDownload(QString bookId, QString path);
+    void downloadVerified(QString bookId, QString path, bool healthy);
+    void queueBookDownload(const kiwix::Book& book);
+    QMap<QString, QStringList> findUpdatableBooks();
+    void handleBooksByName(const QString& name, const QByteArray& opdsFeed, const QString& errorString);
+    const kiwix::Book* findNewestVersion(const kiwix::Book& localBook, const kiwix::Library& remoteLibrary) const;
+    void queueBookUpdates();
+    void replaceUpdatedBook(QString bookId);
+    void loadBookUpdates();
+    void saveBookUpdates() const;
 
 private: // data
     Library* mp_library;
@@ -185,17 +243,47 @@ private: // data
     QString m_searchQuery;
     QString m_categoryFilter = "all";
     QStringList m_contentTypeFilters;
-    kiwix::supportedListSortBy m_sortBy = kiwix::UNSORTED;
-    bool m_sortOrderAsc = true;
     LanguageList m_languages;
     QStringList m_categories;
 
     ContentManagerModel *managerModel;
     QMutex remoteLibraryLocker;
+    int m_remoteLibraryGeneration = 0; // guarded by remoteLibraryLocker
+    QTimer m_searchDebounceTimer;
+    int m_remotePageStart = 0;
+    bool m_remotePageRequestPending = false;
+    bool m_moreRemotePagesAvailable = false;
 
     QFileSystemWatcher m_watcher;
     QMutex m_updateFromDirMutex;
+    // The keys of the maps below are absolute paths with native separators
+    QStringSet m_monitoredDirs;
     QMap<QString, ZimFileName2InfoMap> m_knownZimsInDir;
+    QMap<QString, QStringSet> m_subdirsOfMonitoredDir;
+    QMap<QString, ZimFileName2InfoMap> m_savedKnownZimsInDir;
+    // The directories of m_knownZimsInDir changed since the last
+    // saveKnownZimFiles()
+    QStringSet m_unsavedKnownZimDirs;
+    QMutex m_knownZimFilesSaveMutex;
+    QThreadPool m_zimFileReaderPool;
+
+    ZimIntegrityChecker m_zimIntegrityChecker;
+    // The files of the local books passed to m_zimIntegrityChecker so far
+    // (by book id)
+    QMap<QString, QString> m_integrityCheckedBookFiles;
+    QThreadPool m_downloadVerificationPool;
+    std::atomic<bool> m_stopDownloadVerification{false};
+
+    // Maps the ids of the books being downloaded by updateAllBooks() to the
+    // ids of the local books that they will replace
+    QMap<QString, QString> m_bookUpdates;
+    // State of the search for book updates started by updateAllBooks():
+    // the names of the local books not checked yet (mapped to their ids),
+    // the newer versions found (paired with the ids of the local books)
+    // and the problems to be reported at the end
+    QMap<QString, QStringList> m_booksAwaitingUpdateCheck;
+    QList<QPair<kiwix::Book, QString>> m_foundBookUpdates;
+    QStringList m_bookUpdateFailures;
 };
 
 #endif // CONTENTMANAGER_H
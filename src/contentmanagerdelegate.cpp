@@ -9,6 +9,7 @@
 #include "descriptionnode.h"
 #include "portutils.h"
 #include "css_constants.h"
+#include <algorithm>
 
 ContentManagerDelegate::ContentManagerDelegate(QObject *parent)
     : QStyledItemDelegate(parent), baseButton(new QPushButton)
@@ -102,6 +103,35 @@ void createDownloadStats(QPainter *painter, QRect box, QString downloadSpeed, QS
     painter->setFont(oldFont);
 }
 
+// Draws the throughput history of a download as a line scaled to the
+// highest speed in it
+void createSparkline(QPainter *painter, QRect box, const QVector<double>& history)
+{
+    if ( history.size() < 2 )
+        return;
+
+    const double maxSpeed = *std::max_element(history.begin(), history.end());
+    QPainterPath path;
+    for ( int i = 0; i < history.size(); ++i ) {
+        const double x = box.left() + box.width() * i / double(history.size() - 1);
+        const double level = maxSpeed > 0 ? history[i] / maxSpeed : 0;
+        const double y = box.bottom() - box.height() * level;
+        if ( i == 0 ) {
+            path.moveTo(x, y);
+        } else {
+            path.lineTo(x, y);
+        }
+    }
+
+    QPen pen;
+    pen.setWidth(1);
+    pen.setColor(CSS::ContentManagerCSS::speedSparkline::color);
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->strokePath(path, pen);
+    painter->restore();
+}
+
 struct DownloadControlLayout
 {
     QRect pauseResumeButtonRect;
@@ -137,7 +167,15 @@ void showDownloadProgress(QPainter *painter, QRect box, const DownloadState& dow
         createCancelButton(painter, dcl.cancelButtonRect);
     } else if (downloadInfo.getStatus() == DownloadState::DOWNLOADING) {
         createPauseSymbol(painter, dcl.pauseResumeButtonRect);
-        createDownloadStats(painter, box, downloadSpeed, completedLength);
+        const auto timeLeft = downloadInfo.getEstimatedTimeLeft();
+        createDownloadStats(painter, box, downloadSpeed, completedLength + " - " + timeLeft);
+        const QRect sparklineRect(box.left() + 8, box.bottom() - 14, box.width() / 2 - 16, 10);
+        createSparkline(painter, sparklineRect, downloadInfo.getSpeedHistory());
+    } else if (downloadInfo.getStatus() == DownloadState::VERIFYING) {
+        createDownloadStats(painter, box, gt("download-verifying"), QString::number(downloadInfo.progress) + "%");
+    } else if (downloadInfo.getStatus() == DownloadState::WAITING) {
+        createCancelButton(painter, dcl.cancelButtonRect);
+        createDownloadStats(painter, box, gt("download-waiting"), completedLength);
     }
 
     QPen pen;
@@ -187,6 +225,9 @@ void ContentManagerDelegate::paintBookState(QPainter *p, const QStyleOptionViewI
     case ContentManager::BookState::DOWNLOAD_ERROR:
         return showDownloadProgress(p, r, *node->getDownloadState());
 
+    case ContentManager::BookState::ERROR_CORRUPTED_ZIM_FILE:
+        return p->drawText(r, Qt::AlignCenter, gt("corrupted-zim-file"));
+
     default:
         return;
     }
@@ -260,6 +301,10 @@ void ContentManagerDelegate::handleLastColumnClicked(const QModelIndex& index, Q
             if ( dcl.pauseResumeButtonRect.contains(clickPoint) ) {
                 contentMgr.pauseBook(id, index);
             }
+        } else if ( contentMgr.isQueued(id) ) {
+            if ( dcl.cancelButtonRect.contains(clickPoint) ) {
+                contentMgr.cancelBook(id);
+            }
         }
         return;
 
@@ -3,15 +3,26 @@
 #include "rownode.h"
 #include "descriptionnode.h"
 #include <zim/error.h>
+#include <zim/archive.h>
 #include <zim/item.h>
 #include "kiwixapp.h"
 #include <kiwix/tools.h>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
 
 ContentManagerModel::ContentManagerModel(ContentManager *contentMgr)
     : QAbstractItemModel(contentMgr)
     , m_contentMgr(*contentMgr)
 {
+    rootNode = std::shared_ptr<RowNode>(new RowNode(BookRecord(), std::weak_ptr<RowNode>()));
     connect(&td, &ThumbnailDownloader::oneThumbnailDownloaded, this, &ContentManagerModel::updateImage);
+
+    // Reading thumbnails from ZIM files must not compete with the rest of the
+    // application for I/O
+    m_localThumbnailLoaderPool.setMaxThreadCount(2);
 }
 
 ContentManagerModel::~ContentManagerModel()
@@ -49,7 +60,22 @@ QIcon getIcon(const QByteArray& iconData)
 {
     static QIcon placeholderIcon = createPlaceholderIcon();
 
-    return iconData.isNull() ? placeholderIcon : makeIcon(iconData);
+    return iconData.isEmpty() ? placeholderIcon : makeIcon(iconData);
+}
+
+// Runs in a worker thread. The illustration is read from the ZIM file only,
+// Book::Illustration::getData() would download it if the book refers to it
+// by URL.
+QByteArray readLocalThumbnail(const kiwix::Book& book)
+{
+    try {
+        const zim::Archive archive(book.getPath());
+        const std::string data = archive.getIllustrationItem(48).getData();
+        return QByteArray(data.data(), data.size());
+    } catch ( ... ) {
+        // An empty (but not null) thumbnail stands for the placeholder icon
+        return QByteArray("");
+    }
 }
 
 } // unnamed namespace
@@ -74,18 +100,53 @@ QVariant ContentManagerModel::data(const QModelIndex& index, int role) const
     if ( !isThumbnailRequest )
         return r;
 
+    // Decoding the image on every repaint would make scrolling sluggish
+    const auto rowNode = static_cast<RowNode*>(item);
+    if ( !rowNode->getIcon().isNull() )
+        return rowNode->getIcon();
+
     r = getThumbnail(r);
 
-    if ( r.userType() == QMetaType::QByteArray )
-        return getIcon(r.toByteArray());
+    if ( r.userType() == QMetaType::QByteArray ) {
+        const QIcon icon = getDecodedIcon(rowNode->getBookId(), r.toByteArray());
+        rowNode->setIcon(icon);
+        return icon;
+    }
 
     const QString faviconUrl = r.toString();
     if ( !faviconUrl.isEmpty() )
         td.addDownload(faviconUrl, item->getBookId());
+    else if ( rowNode->record().isLocal )
+        loadLocalThumbnail(item->getBookId());
 
     return QVariant();
 }
 
+// Reads the thumbnail of a local book in the background. Only books whose
+// rows are actually displayed get here.
+void ContentManagerModel::loadLocalThumbnail(const QString& bookId) const
+{
+    if ( m_pendingLocalThumbnails.contains(bookId) )
+        return;
+
+    kiwix::Book book;
+    try {
+        book = KiwixApp::instance()->getLibrary()->getBookById(bookId);
+    } catch ( const std::out_of_range& ) {
+        return;
+    }
+
+    m_pendingLocalThumbnails.insert(bookId);
+    const QPointer<ContentManagerModel> model(const_cast<ContentManagerModel*>(this));
+    (void) QtConcurrent::run(&m_localThumbnailLoaderPool, [=]() {
+        const QByteArray imageData = readLocalThumbnail(book);
+        QMetaObject::invokeMethod(model, [=]() {
+            if ( model )
+                model->setLocalThumbnail(bookId, imageData);
+        }, Qt::QueuedConnection);
+    });
+}
+
 Qt::ItemFlags ContentManagerModel::flags(const QModelIndex &index) const
 {
     Qt::ItemFlags defaultFlags = QAbstractItemModel::flags(index);
@@ -153,22 +214,223 @@ QVariant ContentManagerModel::headerData(int section, Qt::Orientation orientatio
     }
 }
 
-void ContentManagerModel::setBooksData(const BookInfoList& data, const DownloadManager& downloadMgr)
+// Brings the model in sync with data by removing, moving, inserting and
+// updating only the rows that differ, so that views keep their scroll
+// position, selection and expanded rows.
+void ContentManagerModel::setBooksData(const BookRecordList& unsortedData, const DownloadManager& downloadMgr)
 {
-    rootNode = std::shared_ptr<RowNode>(new RowNode({tr("Icon"), tr("Name"), tr("Date"), tr("Size"), tr("Content Type"), tr("Download")}, "", std::weak_ptr<RowNode>()));
-    beginResetModel();
-    bookIdToRowMap.clear();
-    for (auto bookItem : data) {
-        const auto rowNode = createNode(bookItem);
+    BookRecordList data(unsortedData);
+    if ( m_sortColumn != -1 ) {
+        std::stable_sort(data.begin(), data.end(), [this](const BookRecord& a, const BookRecord& b) {
+            return precedes(a, b);
+        });
+    }
 
-        // Restore download state during model updates (filtering, etc)
+    QStringList bookIds;
+    bookIds.reserve(data.size());
+    for (const auto& bookItem : data) {
+        bookIds.append(bookItem.id);
+    }
+    const QSet<QString> bookIdSet(bookIds.begin(), bookIds.end());
+
+    removeRowsNotIn(bookIdSet);
+    reorderRows(bookIds);
+    insertAndUpdateRows(data, downloadMgr);
+}
+
+// Adds rows for the books of data that aren't shown yet (at their sorted
+// position), leaving the existing rows untouched
+void ContentManagerModel::addBooks(const BookRecordList& data, const DownloadManager& downloadMgr)
+{
+    bool rowsInserted = false;
+    for (const auto& bookItem : data) {
+        if ( bookIdToRowMap.contains(bookItem.id) )
+            continue;
+
+        const auto& rows = rootNode->children();
+        int row = rows.size();
+        if ( m_sortColumn != -1 ) {
+            const auto it = std::upper_bound(rows.begin(), rows.end(), bookItem,
+                [this](const BookRecord& record, const std::shared_ptr<Node>& rowNode) {
+                    return precedes(record, static_cast<const RowNode*>(rowNode.get())->record());
+                });
+            row = it - rows.begin();
+        }
+
+        beginInsertRows(QModelIndex(), row, row);
+        const auto rowNode = createNode(bookItem);
         rowNode->setDownloadState(downloadMgr.getDownloadState(rowNode->getBookId()));
+        rootNode->insertChild(row, rowNode);
+        endInsertRows();
+        rowsInserted = true;
+    }
+
+    if ( rowsInserted )
+        rebuildBookIdToRowMap();
+}
+
+void ContentManagerModel::updateBook(const BookRecord& bookItem, const DownloadManager& downloadMgr)
+{
+    const auto it = bookIdToRowMap.constFind(bookItem.id);
+    if ( it != bookIdToRowMap.constEnd() )
+        updateRow(it.value(), bookItem, downloadMgr);
+}
+
+void ContentManagerModel::removeBook(QString bookId)
+{
+    const auto it = bookIdToRowMap.constFind(bookId);
+    if ( it == bookIdToRowMap.constEnd() )
+        return;
+
+    const int row = it.value();
+    beginRemoveRows(QModelIndex(), row, row);
+    rootNode->removeChildren(row, 1);
+    endRemoveRows();
+    rebuildBookIdToRowMap();
+}
+
+void ContentManagerModel::removeRowsNotIn(const QSet<QString>& bookIds)
+{
+    const auto& rows = rootNode->children();
+    bool rowsRemoved = false;
+    int last = rows.size() - 1;
+    while ( last >= 0 ) {
+        if ( bookIds.contains(rows[last]->getBookId()) ) {
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while ( first > 0 && !bookIds.contains(rows[first - 1]->getBookId()) )
+            --first;
+
+        beginRemoveRows(QModelIndex(), first, last);
+        rootNode->removeChildren(first, last - first + 1);
+        endRemoveRows();
+        rowsRemoved = true;
+        last = first - 1;
+    }
+
+    if ( rowsRemoved )
+        rebuildBookIdToRowMap();
+}
+
+// Moves the existing rows into the relative order that they have in bookIds
+// (which must contain the ids of all existing rows).
+void ContentManagerModel::reorderRows(const QStringList& bookIds)
+{
+    QHash<QString, int> newRank;
+    for (int i = 0; i < bookIds.size(); ++i) {
+        newRank.insert(bookIds[i], i);
+    }
+
+    const auto& rows = rootNode->children();
+    bool inOrder = true;
+    for (int i = 1; inOrder && i < rows.size(); ++i) {
+        inOrder = newRank.value(rows[i - 1]->getBookId()) < newRank.value(rows[i]->getBookId());
+    }
+    if ( inOrder )
+        return;
 
-        bookIdToRowMap[bookItem["id"].toString()] = rootNode->childCount();
-        rootNode->appendChild(rowNode);
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    auto sortedRows = rows;
+    std::sort(sortedRows.begin(), sortedRows.end(), [&](const auto& a, const auto& b) {
+        return newRank.value(a->getBookId()) < newRank.value(b->getBookId());
+    });
+
+    QHash<Node*, int> newRowOfNode;
+    for (int i = 0; i < sortedRows.size(); ++i) {
+        newRowOfNode.insert(sortedRows[i].get(), i);
+    }
+    rootNode->setChildren(sortedRows);
+
+    // Description rows keep their (row, column, node) identity, only the
+    // indexes of the top-level rows have to be remapped.
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList newIndexes;
+    for (const auto& index : oldIndexes) {
+        const auto node = static_cast<Node*>(index.internalPointer());
+        const auto it = newRowOfNode.constFind(node);
+        newIndexes.append(it == newRowOfNode.constEnd()
+                          ? index
+                          : createIndex(it.value(), index.column(), node));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+    rebuildBookIdToRowMap();
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+// Assumes that the existing rows are a subsequence of data
+void ContentManagerModel::insertAndUpdateRows(const BookRecordList& data, const DownloadManager& downloadMgr)
+{
+    const auto& rows = rootNode->children();
+    bool rowsInserted = false;
+    int i = 0;
+    while ( i < data.size() ) {
+        if ( i < rows.size() && rows[i]->getBookId() == data[i].id ) {
+            updateRow(i, data[i], downloadMgr);
+            ++i;
+            continue;
+        }
+
+        // Insert the run of new books preceding the next existing row
+        const QString nextExistingId = i < rows.size() ? rows[i]->getBookId() : QString();
+        int end = i + 1;
+        while ( end < data.size() && data[end].id != nextExistingId )
+            ++end;
+
+        beginInsertRows(QModelIndex(), i, end - 1);
+        for ( ; i < end; ++i ) {
+            const auto rowNode = createNode(data[i]);
+
+            // Restore download state during model updates (filtering, etc)
+            rowNode->setDownloadState(downloadMgr.getDownloadState(rowNode->getBookId()));
+            rootNode->insertChild(i, rowNode);
+        }
+        endInsertRows();
+        rowsInserted = true;
+    }
+
+    if ( rowsInserted )
+        rebuildBookIdToRowMap();
+}
+
+void ContentManagerModel::updateRow(int row, const BookRecord& bookItem, const DownloadManager& downloadMgr)
+{
+    const auto rowNode = getRowNode(row);
+    BookRecord newRecord = withKnownThumbnail(bookItem);
+
+    // Don't drop a thumbnail that has already been downloaded
+    const BookRecord& oldRecord = rowNode->record();
+    if ( newRecord.faviconData.isNull() )
+        newRecord.faviconData = oldRecord.faviconData;
+
+    if ( newRecord != oldRecord ) {
+        if ( newRecord.faviconData != oldRecord.faviconData )
+            m_decodedIcons.remove(bookItem.id);
+        const bool descriptionChanged = newRecord.description != oldRecord.description;
+        rowNode->setRecord(newRecord);
+        emit dataChanged(index(row, 0), index(row, 4));
+        if ( descriptionChanged ) {
+            const auto descIndex = index(0, 0, index(row, 0));
+            emit dataChanged(descIndex, descIndex);
+        }
+    }
+
+    const auto downloadState = downloadMgr.getDownloadState(rowNode->getBookId());
+    if ( downloadState != rowNode->getDownloadState() ) {
+        rowNode->setDownloadState(downloadState);
+        triggerDataUpdateAt(index(row, 5));
+    }
+}
+
+void ContentManagerModel::rebuildBookIdToRowMap()
+{
+    bookIdToRowMap.clear();
+    const auto& rows = rootNode->children();
+    for (int i = 0; i < rows.size(); ++i) {
+        bookIdToRowMap[rows[i]->getBookId()] = i;
     }
-    endResetModel();
-    emit dataChanged(QModelIndex(), QModelIndex());
 }
 
 // Returns either data of the thumbnail (as a QByteArray) or a URL (as a
@@ -184,19 +446,37 @@ QVariant ContentManagerModel::getThumbnail(const QVariant& faviconEntry) const
          : faviconEntry;
 }
 
-std::shared_ptr<RowNode> ContentManagerModel::createNode(BookInfo bookItem) const
+QIcon ContentManagerModel::getDecodedIcon(const QString& bookId, const QByteArray& iconData) const
+{
+    const auto it = m_decodedIcons.constFind(bookId);
+    if ( it != m_decodedIcons.constEnd() )
+        return it.value();
+
+    const QIcon icon = getIcon(iconData);
+    m_decodedIcons.insert(bookId, icon);
+    return icon;
+}
+
+// Fills in the thumbnail data if it was already downloaded from the favicon
+// URL of the book
+BookRecord ContentManagerModel::withKnownThumbnail(const BookRecord& bookItem) const
+{
+    BookRecord record(bookItem);
+    if ( record.faviconData.isNull() ) {
+        record.faviconData = record.isLocal
+                           ? m_localIconMap.value(record.id)
+                           : m_iconMap.value(record.faviconUrl);
+    }
+    return record;
+}
+
+std::shared_ptr<RowNode> ContentManagerModel::createNode(const BookRecord& bookItem) const
 {
-    QString id = bookItem["id"].toString();
-    const QVariant bookIcon = getThumbnail(bookItem["favicon"]);
     std::weak_ptr<RowNode> weakRoot = rootNode;
-    auto rowNodePtr = std::shared_ptr<RowNode>(new
-                                    RowNode({bookIcon, bookItem["title"],
-                                   bookItem["date"],
-                                   QString::fromStdString(kiwix::beautifyFileSize(bookItem["size"].toULongLong())),
-                                   bookItem["tags"]
-                                   }, id, weakRoot));
+    auto rowNodePtr = std::shared_ptr<RowNode>(new RowNode(withKnownThumbnail(bookItem), weakRoot));
+    rowNodePtr->setIcon(m_decodedIcons.value(bookItem.id));
     std::weak_ptr<RowNode> weakRowNodePtr = rowNodePtr;
-    const auto descNodePtr = std::make_shared<DescriptionNode>(DescriptionNode(bookItem["description"].toString(), weakRowNodePtr));
+    const auto descNodePtr = std::make_shared<DescriptionNode>(weakRowNodePtr);
 
     rowNodePtr->appendChild(descNodePtr);
     return rowNodePtr;
@@ -210,26 +490,53 @@ bool ContentManagerModel::hasChildren(const QModelIndex &parent) const
     return true;
 }
 
+bool ContentManagerModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_contentMgr.canFetchMoreBooks();
+}
+
+void ContentManagerModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid())
+        m_contentMgr.fetchMoreBooks();
+}
+
+// Whether the row of book a must be placed before the row of book b
+// according to the current sort column and order
+bool ContentManagerModel::precedes(const BookRecord& a, const BookRecord& b) const
+{
+    const BookRecord& first  = m_sortOrder == Qt::AscendingOrder ? a : b;
+    const BookRecord& second = m_sortOrder == Qt::AscendingOrder ? b : a;
+    switch (m_sortColumn) {
+        case 1: return first.titleSortKey < second.titleSortKey;
+        case 2: return first.date < second.date;
+        case 3: return first.size < second.size;
+        default: return false;
+    }
+}
+
+// Reorders the rows loaded so far in place (without refiltering the library).
+// Pages of the catalog fetched later are inserted at their sorted position.
 void ContentManagerModel::sort(int column, Qt::SortOrder order)
 {
     if (column == 0 || column == 4 || column == 5)
         return;
 
-    QString sortBy = "";
-    switch(column) {
-        case 1:
-            sortBy = "title";
-            break;
-        case 2:
-            sortBy = "date";
-            break;
-        case 3:
-            sortBy = "size";
-            break;
-        default:
-            sortBy = "unsorted";
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    auto rows = rootNode->children();
+    std::stable_sort(rows.begin(), rows.end(), [this](const auto& a, const auto& b) {
+        return precedes(static_cast<const RowNode*>(a.get())->record(),
+                        static_cast<const RowNode*>(b.get())->record());
+    });
+
+    QStringList bookIds;
+    bookIds.reserve(rows.size());
+    for (const auto& row : rows) {
+        bookIds.append(row->getBookId());
     }
-    m_contentMgr.setSortBy(sortBy, order == Qt::AscendingOrder);
+    reorderRows(bookIds);
 }
 
 RowNode* ContentManagerModel::getRowNode(size_t row)
@@ -239,6 +546,7 @@ RowNode* ContentManagerModel::getRowNode(size_t row)
 
 void ContentManagerModel::updateImage(QString bookId, QString url, QByteArray imageData)
 {
+    m_decodedIcons.remove(bookId);
     const auto it = bookIdToRowMap.constFind(bookId);
     if ( it == bookIdToRowMap.constEnd() )
         return;
@@ -250,6 +558,21 @@ void ContentManagerModel::updateImage(QString bookId, QString url, QByteArray im
     triggerDataUpdateAt( this->index(row, 0) );
 }
 
+void ContentManagerModel::setLocalThumbnail(QString bookId, QByteArray imageData)
+{
+    m_pendingLocalThumbnails.remove(bookId);
+    m_localIconMap[bookId] = imageData;
+    m_decodedIcons.remove(bookId);
+
+    const auto it = bookIdToRowMap.constFind(bookId);
+    if ( it == bookIdToRowMap.constEnd() )
+        return;
+
+    const size_t row = it.value();
+    getRowNode(row)->setIconData(imageData);
+    triggerDataUpdateAt( this->index(row, 0) );
+}
+
 void ContentManagerModel::updateDownload(QString bookId)
 {
     const auto it = bookIdToRowMap.constFind(bookId);
@@ -5,8 +5,12 @@
 #include <QModelIndex>
 #include <QVariant>
 #include <QIcon>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
 #include "thumbnaildownloader.h"
 #include "rownode.h"
+#include "bookrecord.h"
 #include "downloadmanagement.h"
 #include <memory>
 
@@ -19,10 +23,6 @@ class ContentManagerModel : public QAbstractItemModel
 {
     Q_OBJECT
 
-public: // types
-    typedef QMap<QString, QVariant> BookInfo;
-    typedef QList<BookInfo>         BookInfoList;
-
 public: // functions
     explicit ContentManagerModel(ContentManager* contentMgr);
     ~ContentManagerModel();
@@ -36,14 +36,20 @@ public: // functions
     QModelIndex parent(const QModelIndex &index) const override;
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
-    void setBooksData(const BookInfoList& data, const DownloadManager& downloadMgr);
+    void setBooksData(const BookRecordList& data, const DownloadManager& downloadMgr);
+    void addBooks(const BookRecordList& data, const DownloadManager& downloadMgr);
+    void updateBook(const BookRecord& bookItem, const DownloadManager& downloadMgr);
+    void removeBook(QString bookId);
     bool hasChildren(const QModelIndex &parent) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
 
-    std::shared_ptr<RowNode> createNode(BookInfo bookItem) const;
+    std::shared_ptr<RowNode> createNode(const BookRecord& bookItem) const;
 
 public slots:
     void updateImage(QString bookId, QString url, QByteArray imageData);
+    void setLocalThumbnail(QString bookId, QByteArray imageData);
     void triggerDataUpdateAt(QModelIndex index);
     void setDownloadState(QString bookId, std::shared_ptr<DownloadState> ds);
     void updateDownload(QString bookId);
@@ -52,7 +58,16 @@ private: // functions
     // Returns either data of the thumbnail (as a QByteArray) or a URL (as a
     // QString) from where the actual data can be obtained.
     QVariant getThumbnail(const QVariant& faviconEntry) const;
+    QIcon getDecodedIcon(const QString& bookId, const QByteArray& iconData) const;
     RowNode* getRowNode(size_t row);
+    BookRecord withKnownThumbnail(const BookRecord& bookItem) const;
+    void loadLocalThumbnail(const QString& bookId) const;
+    bool precedes(const BookRecord& a, const BookRecord& b) const;
+    void removeRowsNotIn(const QSet<QString>& bookIds);
+    void reorderRows(const QStringList& bookIds);
+    void insertAndUpdateRows(const BookRecordList& data, const DownloadManager& downloadMgr);
+    void updateRow(int row, const BookRecord& bookItem, const DownloadManager& downloadMgr);
+    void rebuildBookIdToRowMap();
 
 private: // data
     ContentManager& m_contentMgr;
@@ -60,6 +75,19 @@ private: // data
     mutable ThumbnailDownloader td;
     QMap<QString, size_t> bookIdToRowMap;
     QMap<QString, QByteArray> m_iconMap;
+
+    // Decoded thumbnails, by book id (they are also kept by the rows, this
+    // map preserves them when rows are recreated)
+    mutable QHash<QString, QIcon> m_decodedIcons;
+
+    // The rows are kept sorted by this column (no sorting if -1)
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+
+    // Thumbnails of local books, by book id
+    QMap<QString, QByteArray> m_localIconMap;
+    mutable QSet<QString> m_pendingLocalThumbnails;
+    mutable QThreadPool m_localThumbnailLoaderPool;
 };
 
 inline bool isDescriptionIndex(const QModelIndex& index)
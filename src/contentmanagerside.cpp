@@ -32,6 +32,7 @@ ContentManagerSide::ContentManagerSide(QWidget *parent) :
 
     mp_ui->allFileButton->setText(gt("online-files"));
     mp_ui->localFileButton ->setText(gt("local-files"));
+    mp_ui->updateAllButton->setText(gt("update-all-books"));
 
     mp_categories = mp_ui->categories;
     mp_categories->setType("category");
@@ -92,6 +93,8 @@ void ContentManagerSide::setContentManager(ContentManager *contentManager)
     connect(mp_contentType, &KiwixChoiceBox::choiceUpdated, this, [=](FilterList values) {
         mp_contentManager->setCurrentContentTypeFilter(values);
     });
+    connect(mp_ui->updateAllButton, &QPushButton::clicked,
+            mp_contentManager, &ContentManager::updateAllBooks);
 }
 
 namespace
@@ -61,6 +61,11 @@ namespace ContentManagerCSS {
 namespace QTreeView {
     const int padding = 4;
 }
+
+/* Drawn by ContentManagerDelegate, same as the #3366CC borders of style.css */
+namespace speedSparkline {
+    const char* const color = "#3366cc";
+}
 }
 
 /* In popup.css */
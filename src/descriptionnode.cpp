@@ -1,8 +1,8 @@
 #include "descriptionnode.h"
 #include "rownode.h"
 
-DescriptionNode::DescriptionNode(QString desc, std::weak_ptr<RowNode> parent)
-    : m_desc(desc), m_parentItem(parent)
+DescriptionNode::DescriptionNode(std::weak_ptr<RowNode> parent)
+    : m_parentItem(parent)
 {}
 
 DescriptionNode::~DescriptionNode()
@@ -36,9 +36,14 @@ int DescriptionNode::columnCount() const
 
 QVariant DescriptionNode::data(int column)
 {
-    if (column == 0)
-        return m_desc;
-    return QVariant();
+    if (column != 0)
+        return QVariant();
+
+    // The description is stored in the book record of the parent row
+    std::shared_ptr<RowNode> temp = m_parentItem.lock();
+    if (!temp)
+        return QVariant();
+    return temp->record().description;
 }
 
 int DescriptionNode::row() const
@@ -9,7 +9,7 @@ class RowNode;
 class DescriptionNode : public Node
 {
 public:
-    DescriptionNode(QString desc, std::weak_ptr<RowNode> parent);
+    explicit DescriptionNode(std::weak_ptr<RowNode> parent);
     ~DescriptionNode();
     std::shared_ptr<Node> parentItem() override;
     int childCount() const override;
@@ -19,7 +19,6 @@ public:
     QString getBookId() const override;
 
 private:
-    QString m_desc;
     std::weak_ptr<RowNode> m_parentItem;
 };
 
@@ -3,8 +3,12 @@
 #include "kiwixapp.h"
 #include "kiwixmessagebox.h"
 
+#include <QDebug>
+#include <QFileInfo>
+#include <QSettings>
 #include <QStorageInfo>
 #include <QThread>
+#include <QTime>
 
 ////////////////////////////////////////////////////////////////////////////////
 // DowloadState
@@ -48,12 +52,30 @@ bool DownloadState::isLateUpdateInfo(const DownloadInfo& info) const
 
 void DownloadState::update(const DownloadInfo& info)
 {
+    // Weight of the latest sample in the smoothed download speed
+    const double SPEED_SMOOTHING_FACTOR = 0.3;
+
     const auto completedBytes = info["completedLength"].toDouble();
-    const double percentage = completedBytes / info["totalLength"].toDouble();
+    const auto totalBytes = info["totalLength"].toDouble();
+    const double percentage = completedBytes / totalBytes;
 
     progress = QString::number(100 * percentage, 'g', 3).toDouble();
     completedLength = convertToUnits(completedBytes);
-    downloadSpeed = convertToUnits(info["downloadSpeed"].toDouble()) + "/s";
+    remainingBytes = std::max(0.0, totalBytes - completedBytes);
+
+    const double speed = info["downloadSpeed"].toDouble();
+    smoothedSpeed = smoothedSpeed < 0
+                  ? speed
+                  : SPEED_SMOOTHING_FACTOR * speed + (1 - SPEED_SMOOTHING_FACTOR) * smoothedSpeed;
+
+    const int historyEnd = (speedHistoryStart + speedHistoryLength) % SPEED_HISTORY_SIZE;
+    speedHistory[historyEnd] = speed;
+    if ( speedHistoryLength < SPEED_HISTORY_SIZE ) {
+        ++speedHistoryLength;
+    } else {
+        speedHistoryStart = (speedHistoryStart + 1) % SPEED_HISTORY_SIZE;
+    }
+
     if ( !isLateUpdateInfo(info) ) {
         status = getDownloadStatus(info["status"].toString());
     }
@@ -70,7 +92,33 @@ double DownloadState::timeSinceLastUpdate() const
 
 QString DownloadState::getDownloadSpeed() const
 {
-    return timeSinceLastUpdate() > 2.0 ? "---" : downloadSpeed;
+    if ( timeSinceLastUpdate() > 2.0 || smoothedSpeed < 0 )
+        return "---";
+    return convertToUnits(smoothedSpeed) + "/s";
+}
+
+QString DownloadState::getEstimatedTimeLeft() const
+{
+    if ( timeSinceLastUpdate() > 2.0 || smoothedSpeed < 1 )
+        return "---";
+
+    const qint64 seconds = qint64(remainingBytes / smoothedSpeed);
+    const QString minutesAndSeconds = QString("%1:%2")
+        .arg((seconds / 60) % 60, 2, 10, QChar('0'))
+        .arg(seconds % 60, 2, 10, QChar('0'));
+    return seconds >= 3600
+         ? QString::number(seconds / 3600) + ":" + minutesAndSeconds
+         : minutesAndSeconds;
+}
+
+QVector<double> DownloadState::getSpeedHistory() const
+{
+    QVector<double> history;
+    history.reserve(speedHistoryLength);
+    for ( int i = 0; i < speedHistoryLength; ++i ) {
+        history.append(speedHistory[(speedHistoryStart + i) % SPEED_HISTORY_SIZE]);
+    }
+    return history;
 }
 
 void DownloadState::changeState(Action action)
@@ -102,6 +150,49 @@ void DownloadState::changeState(Action action)
 namespace
 {
 
+QString getDownloadQueueFilePath()
+{
+    return getDataDirectory() + "/download-queue.ini";
+}
+
+// windows are strings in the form "HH:mm-HH:mm", a window ending before it
+// starts spans midnight
+bool isInsideDownloadWindows(const QStringList& windows, const QTime& time)
+{
+    if ( windows.isEmpty() )
+        return true;
+
+    for ( const auto& window : windows ) {
+        const QStringList bounds = window.split('-');
+        if ( bounds.size() != 2 )
+            continue;
+
+        const QTime start = QTime::fromString(bounds[0].trimmed(), "HH:mm");
+        const QTime end = QTime::fromString(bounds[1].trimmed(), "HH:mm");
+        if ( !start.isValid() || !end.isValid() )
+            continue;
+
+        const bool inside = start <= end
+                          ? start <= time && time < end
+                          : start <= time || time < end;
+        if ( inside )
+            return true;
+    }
+    return false;
+}
+
+bool isInsideDownloadWindows()
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    return isInsideDownloadWindows(settingsMgr->getDownloadWindows(), QTime::currentTime());
+}
+
+bool downloadingIsAllowedNow()
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    return !settingsMgr->getPauseDownloadsOutsideWindows() || isInsideDownloadWindows();
+}
+
 kiwix::Downloader* createDownloader()
 {
     try {
@@ -148,15 +239,30 @@ void DownloadManager::processDownloadActions()
         if ( !req.bookId.isEmpty() ) {
             switch ( req.action ) {
             case DownloadState::START:  startDownload(req.bookId);  break;
+            case DownloadState::APPLY_OPTIONS: applyDownloadOptions(req.bookId); break;
             case DownloadState::PAUSE:  pauseDownload(req.bookId);  break;
             case DownloadState::RESUME: resumeDownload(req.bookId); break;
             case DownloadState::CANCEL: cancelDownload(req.bookId); break;
             case DownloadState::UPDATE: updateDownload(req.bookId); break;
             }
+        } else if ( req.action == DownloadState::UPDATE && mp_downloadUpdaterThread != nullptr ) {
+            updateAllDownloads();
         }
     }
 }
 
+namespace
+{
+
+// The progress of the downloads is polled frequently only while it is
+// being displayed
+const int WATCHED_DOWNLOADS_UPDATE_INTERVAL_MS = 1000;
+const int BACKGROUND_DOWNLOADS_UPDATE_INTERVAL_MS = 5000;
+
+const int REQUEST_QUEUE_METRICS_LOG_INTERVAL_MS = 60000;
+
+} // unnamed namespace
+
 void DownloadManager::startDownloadUpdaterThread()
 {
     // so that DownloadInfo can be copied across threads
@@ -168,15 +274,36 @@ void DownloadManager::startDownloadUpdaterThread()
 
     mp_downloadUpdaterThread->start();
 
+    // A single request updates all the downloads (a request with an empty
+    // book id stands for all downloads). If the previous one is still
+    // pending, the new one is merged into it.
     QTimer *timer = new QTimer(this);
-    connect(timer, &QTimer::timeout, [this]() {
-        if ( m_requestQueue.isEmpty() ) {
-            for ( const auto& bookId : m_downloads.keys() ) {
-                addRequest(DownloadState::UPDATE, bookId);
-            }
+    connect(timer, &QTimer::timeout, [this, timer]() {
+        if ( !m_downloads.keys().isEmpty() ) {
+            m_requestQueue.enqueue({DownloadState::UPDATE, ""});
+        }
+        applyDownloadSchedule();
+        startQueuedDownloads();
+        timer->setInterval(downloadsAreBeingWatched()
+                           ? WATCHED_DOWNLOADS_UPDATE_INTERVAL_MS
+                           : BACKGROUND_DOWNLOADS_UPDATE_INTERVAL_MS);
+    });
+    timer->start(WATCHED_DOWNLOADS_UPDATE_INTERVAL_MS);
+
+    QTimer *metricsTimer = new QTimer(this);
+    connect(metricsTimer, &QTimer::timeout, [this]() {
+        if ( !m_downloads.keys().isEmpty() ) {
+            logRequestQueueMetrics();
         }
     });
-    timer->start(1000);
+    metricsTimer->start(REQUEST_QUEUE_METRICS_LOG_INTERVAL_MS);
+}
+
+void DownloadManager::logRequestQueueMetrics() const
+{
+    qInfo() << "Download request queue: depth" << m_requestQueue.size()
+            << "max depth" << m_requestQueue.maxSize()
+            << "coalesced requests" << m_requestQueue.coalescedCount();
 }
 
 void DownloadManager::restoreDownloads()
@@ -188,6 +315,270 @@ void DownloadManager::restoreDownloads()
             m_downloads.set(bookId, newDownload);
         }
     }
+    restoreDownloadQueue();
+
+    QSettings settings(getDownloadQueueFilePath(), QSettings::IniFormat);
+    for ( const auto& bookId : settings.value("schedule/pausedBySchedule").toStringList() ) {
+        if ( getDownloadState(bookId) ) {
+            m_downloadsPausedBySchedule.insert(bookId);
+        }
+    }
+    for ( const auto& bookId : settings.value("schedule/resumedByUser").toStringList() ) {
+        if ( getDownloadState(bookId) ) {
+            m_downloadsResumedByUser.insert(bookId);
+        }
+    }
+    // aria2 restores the downloads with the options they were started with
+    settings.beginGroup("rateLimits");
+    for ( const auto& bookId : settings.childKeys() ) {
+        if ( getDownloadState(bookId) ) {
+            m_downloadRateLimits[bookId] = settings.value(bookId).toInt();
+        }
+    }
+    settings.endGroup();
+    m_wasInsideDownloadWindows = isInsideDownloadWindows();
+}
+
+// Outside the download time windows the active downloads are paused (if so
+// configured), except those that the user has resumed outside the windows.
+// They are resumed when a window opens again, unless the user has resumed or
+// cancelled them in the meantime. The rate limit of the running downloads
+// changes when a window opens or closes.
+void DownloadManager::applyDownloadSchedule()
+{
+    const bool insideDownloadWindows = isInsideDownloadWindows();
+    if ( insideDownloadWindows != m_wasInsideDownloadWindows ) {
+        m_wasInsideDownloadWindows = insideDownloadWindows;
+        for ( const auto& bookId : m_downloads.keys() ) {
+            if ( downloadHasBeenStarted(bookId) ) {
+                addRequest(DownloadState::APPLY_OPTIONS, bookId);
+            }
+        }
+    }
+
+    const auto pausedBySchedule = m_downloadsPausedBySchedule;
+    const auto resumedByUser = m_downloadsResumedByUser;
+    if ( !downloadingIsAllowedNow() ) {
+        for ( const auto& bookId : m_downloads.keys() ) {
+            const auto downloadState = getDownloadState(bookId);
+            if ( downloadState && downloadState->getStatus() == DownloadState::DOWNLOADING
+                 && !m_downloadsResumedByUser.contains(bookId) ) {
+                addRequest(DownloadState::PAUSE, bookId);
+                m_downloadsPausedBySchedule.insert(bookId);
+            }
+        }
+    } else {
+        m_downloadsResumedByUser.clear();
+        for ( const auto& bookId : pausedBySchedule ) {
+            const auto downloadState = getDownloadState(bookId);
+            const auto status = downloadState ? downloadState->getStatus() : DownloadState::UNKNOWN;
+            if ( status == DownloadState::PAUSE_REQUESTED )
+                continue; // the pause hasn't been confirmed yet
+
+            if ( status == DownloadState::PAUSED ) {
+                addRequest(DownloadState::RESUME, bookId);
+            }
+            m_downloadsPausedBySchedule.remove(bookId);
+        }
+    }
+
+    if ( m_downloadsPausedBySchedule != pausedBySchedule
+         || m_downloadsResumedByUser != resumedByUser ) {
+        saveDownloadSchedule();
+    }
+}
+
+// A download resumed by the user outside the download time windows is not
+// paused again until the next window is over
+void DownloadManager::resumeDownloadAtUserRequest(QString bookId)
+{
+    addRequest(DownloadState::RESUME, bookId);
+    m_downloadsPausedBySchedule.remove(bookId);
+    if ( !downloadingIsAllowedNow() ) {
+        m_downloadsResumedByUser.insert(bookId);
+    }
+    saveDownloadSchedule();
+}
+
+void DownloadManager::saveDownloadSchedule() const
+{
+    QSettings settings(getDownloadQueueFilePath(), QSettings::IniFormat);
+    settings.setValue("schedule/pausedBySchedule", QStringList(m_downloadsPausedBySchedule.values()));
+    settings.setValue("schedule/resumedByUser", QStringList(m_downloadsResumedByUser.values()));
+}
+
+void DownloadManager::saveDownloadRateLimits() const
+{
+    QSettings settings(getDownloadQueueFilePath(), QSettings::IniFormat);
+    settings.remove("rateLimits");
+    settings.beginGroup("rateLimits");
+    for ( auto it = m_downloadRateLimits.begin(); it != m_downloadRateLimits.end(); ++it ) {
+        settings.setValue(it.key(), it.value());
+    }
+    settings.endGroup();
+}
+
+void DownloadManager::scheduleDownload(QString bookId)
+{
+    const auto newDownload = std::make_shared<DownloadState>();
+    newDownload->markAsWaiting();
+    m_downloads.set(bookId, newDownload);
+    m_queuedDownloads.append(bookId);
+    saveDownloadQueue();
+    startQueuedDownloads();
+}
+
+bool DownloadManager::cancelQueuedDownload(QString bookId)
+{
+    if ( !m_queuedDownloads.removeOne(bookId) )
+        return false;
+
+    m_downloadPriorities.remove(bookId);
+    saveDownloadQueue();
+    return true;
+}
+
+void DownloadManager::setDownloadPriority(QString bookId, int priority)
+{
+    m_downloadPriorities[bookId] = priority;
+    saveDownloadQueue();
+}
+
+int DownloadManager::getHighestDownloadPriority() const
+{
+    int highestPriority = 0;
+    for ( const auto& bookId : m_queuedDownloads ) {
+        highestPriority = std::max(highestPriority, m_downloadPriorities.value(bookId));
+    }
+    return highestPriority;
+}
+
+// A lower maximum number of active downloads only applies to the downloads
+// started from now on, a higher one starts queued downloads right away. The
+// running downloads are restarted if their rate limit has changed.
+void DownloadManager::applyDownloadSettings()
+{
+    applyDownloadSchedule();
+    startQueuedDownloads();
+    for ( const auto& bookId : m_downloads.keys() ) {
+        if ( downloadHasBeenStarted(bookId) ) {
+            addRequest(DownloadState::APPLY_OPTIONS, bookId);
+        }
+    }
+}
+
+// Paused and failed downloads and downloads being verified don't count as
+// active
+void DownloadManager::startQueuedDownloads()
+{
+    if ( !downloadingIsAllowedNow() )
+        return;
+
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    const int maxActiveDownloads = settingsMgr->getMaxActiveDownloads();
+    int activeDownloads = 0;
+    for ( const auto& bookId : m_downloads.keys() ) {
+        const auto downloadState = getDownloadState(bookId);
+        const auto status = downloadState ? downloadState->getStatus() : DownloadState::UNKNOWN;
+        if ( !isQueued(bookId) && downloadState
+             && status != DownloadState::PAUSE_REQUESTED
+             && status != DownloadState::PAUSED
+             && status != DownloadState::DOWNLOAD_ERROR
+             && status != DownloadState::VERIFYING ) {
+            ++activeDownloads;
+        }
+    }
+
+    bool queueChanged = false;
+    while ( !m_queuedDownloads.isEmpty()
+            && (maxActiveDownloads <= 0 || activeDownloads < maxActiveDownloads) ) {
+        addRequest(DownloadState::START, takeNextQueuedDownload());
+        ++activeDownloads;
+        queueChanged = true;
+    }
+    if ( queueChanged ) {
+        saveDownloadQueue();
+    }
+}
+
+// The queued downloads don't use any disk space yet but will do so when
+// they are started
+uint64_t DownloadManager::getQueuedDownloadsSize(const QString& downloadDirPath) const
+{
+    const QStorageInfo storage(downloadDirPath);
+    uint64_t size = 0;
+    for ( const auto& bookId : m_queuedDownloads ) {
+        try {
+            const kiwix::Book& book = mp_library->getBookById(bookId);
+            const QFileInfo fileInfo(QString::fromStdString(book.getPath()));
+            if ( QStorageInfo(fileInfo.absolutePath()) == storage ) {
+                size += book.getSize();
+            }
+        } catch ( const std::out_of_range& ) {}
+    }
+    return size;
+}
+
+QString DownloadManager::takeNextQueuedDownload()
+{
+    const auto queueOrder = KiwixApp::instance()->getSettingsManager()->getDownloadQueueOrder();
+    int next = 0;
+    for ( int i = 1; i < m_queuedDownloads.size(); ++i ) {
+        const QString& candidate = m_queuedDownloads[i];
+        const QString& best = m_queuedDownloads[next];
+        if ( queueOrder == "smallest-first" ) {
+            try {
+                if ( mp_library->getBookById(candidate).getSize() < mp_library->getBookById(best).getSize() )
+                    next = i;
+            } catch ( const std::out_of_range& ) {}
+        } else if ( queueOrder == "priority" ) {
+            if ( m_downloadPriorities.value(candidate) > m_downloadPriorities.value(best) )
+                next = i;
+        }
+    }
+    const QString bookId = m_queuedDownloads.takeAt(next);
+    m_downloadPriorities.remove(bookId);
+    return bookId;
+}
+
+void DownloadManager::saveDownloadQueue() const
+{
+    QSettings settings(getDownloadQueueFilePath(), QSettings::IniFormat);
+    settings.remove("queue");
+    settings.beginWriteArray("queue");
+    for ( int i = 0; i < m_queuedDownloads.size(); ++i ) {
+        settings.setArrayIndex(i);
+        settings.setValue("bookId", m_queuedDownloads[i]);
+        settings.setValue("priority", m_downloadPriorities.value(m_queuedDownloads[i]));
+    }
+    settings.endArray();
+}
+
+// The queued books are in the library (with an empty download id) so that
+// they are displayed as being downloaded
+void DownloadManager::restoreDownloadQueue()
+{
+    QSettings settings(getDownloadQueueFilePath(), QSettings::IniFormat);
+    const int count = settings.beginReadArray("queue");
+    for ( int i = 0; i < count; ++i ) {
+        settings.setArrayIndex(i);
+        const QString bookId = settings.value("bookId").toString();
+        try {
+            if ( !mp_library->getBookById(bookId).getDownloadId().empty() )
+                continue;
+        } catch ( const std::out_of_range& ) {
+            continue;
+        }
+        const auto newDownload = std::make_shared<DownloadState>();
+        newDownload->markAsWaiting();
+        m_downloads.set(bookId, newDownload);
+        m_queuedDownloads.append(bookId);
+        const int priority = settings.value("priority", 0).toInt();
+        if ( priority != 0 ) {
+            m_downloadPriorities[bookId] = priority;
+        }
+    }
+    settings.endArray();
 }
 
 void DownloadManager::updateDownload(QString bookId)
@@ -205,6 +596,31 @@ void DownloadManager::updateDownload(QString bookId)
     emit downloadUpdated(bookId, downloadInfo);
 }
 
+// The downloads paused by the user are skipped since their state can change
+// only as a result of our own requests (after which they are updated anyway).
+// So are the downloads waiting in our queue, aria2 doesn't know about them,
+// and the completed downloads being verified.
+void DownloadManager::updateAllDownloads()
+{
+    for ( const auto& bookId : m_downloads.keys() ) {
+        const auto downloadState = getDownloadState(bookId);
+        if ( downloadState && downloadState->getStatus() != DownloadState::PAUSED
+             && downloadState->getStatus() != DownloadState::VERIFYING
+             && downloadHasBeenStarted(bookId) ) {
+            updateDownload(bookId);
+        }
+    }
+}
+
+bool DownloadManager::downloadHasBeenStarted(const QString& bookId) const
+{
+    try {
+        return !mp_library->getBookById(bookId).getDownloadId().empty();
+    } catch ( const std::out_of_range& ) {
+        return false;
+    }
+}
+
 namespace
 {
 
@@ -268,7 +684,27 @@ uint64_t getMaxFileSize(const QStorageInfo& storageInfo)
     return problematicFileSystems.value(fsType, virtuallyNoLimit);
 }
 
-void checkThatBookCanBeSaved(const kiwix::Book& book, QString targetDir)
+// Allocating the whole file before the download starts prevents it from
+// being fragmented (a ZIM file is written piecewise by aria2)
+std::string getFileAllocationMethod(const QStorageInfo& storageInfo, bool preallocate)
+{
+    if ( !preallocate )
+        return "none";
+
+    // Filesystems supporting fallocate() (or its equivalent, such as
+    // SetFileValidData() on NTFS), where the allocation is instantaneous.
+    // On the others aria2 would have to write the file in full before
+    // downloading it, which takes too long for multi-GB files, so nothing
+    // is allocated in advance.
+    static const QList<QByteArray> fallocCapableFileSystems = {
+        "ext4", "xfs", "btrfs", "f2fs", "apfs", "hfs", "NTFS", "ntfs", "ntfs3"
+    };
+
+    const auto fsType = storageInfo.fileSystemType();
+    return fallocCapableFileSystems.contains(fsType) ? "falloc" : "none";
+}
+
+void checkThatBookCanBeSaved(const kiwix::Book& book, QString targetDir, uint64_t reservedBytes)
 {
     const QFileInfo targetDirInfo(targetDir);
     if ( !targetDirInfo.isDir() ) {
@@ -285,7 +721,7 @@ void checkThatBookCanBeSaved(const kiwix::Book& book, QString targetDir)
 
     QStorageInfo storage(targetDir);
     auto bytesAvailable = storage.bytesAvailable();
-    if (bytesAvailable == -1 || book.getSize() > (unsigned long long) bytesAvailable) {
+    if (bytesAvailable == -1 || book.getSize() + reservedBytes > (unsigned long long) bytesAvailable) {
         throw KiwixAppError(gt("download-storage-error"),
                             gt("download-storage-error-text"));
     }
@@ -299,12 +735,12 @@ void checkThatBookCanBeSaved(const kiwix::Book& book, QString targetDir)
 } // unnamed namespace
 
 
-void DownloadManager::checkThatBookCanBeDownloaded(const kiwix::Book& book, const QString& downloadDirPath)
+void DownloadManager::checkThatBookCanBeDownloaded(const kiwix::Book& book, const QString& downloadDirPath, uint64_t reservedBytes)
 {
     if ( ! DownloadManager::downloadingFunctionalityAvailable() )
         throwDownloadUnavailableError();
 
-    checkThatBookCanBeSaved(book, downloadDirPath);
+    checkThatBookCanBeSaved(book, downloadDirPath, reservedBytes);
 }
 
 std::string DownloadManager::startDownload(const kiwix::Book& book, const QString& downloadDirPath)
@@ -313,19 +749,75 @@ std::string DownloadManager::startDownload(const kiwix::Book& book, const QStrin
     const QString bookId = QString::fromStdString(book.getId());
 
     std::string downloadId;
+    const int rateLimit = getDownloadRateLimit();
     try {
-        const auto d = mp_downloader->startDownload(url, downloadDirPath.toStdString());
+        const auto d = mp_downloader->startDownload(url, downloadDirPath.toStdString(), getDownloadOptions(downloadDirPath));
         downloadId = d->getDid();
     } catch (std::exception& e) {
         throwDownloadUnavailableError();
     }
 
+    m_downloadRateLimits[bookId] = rateLimit;
+    saveDownloadRateLimits();
     return downloadId;
 }
 
+namespace
+{
+
+// The stricter of two rate limits (0 means no limit)
+int stricterRateLimit(int a, int b)
+{
+    if ( a <= 0 ) return b;
+    if ( b <= 0 ) return a;
+    return std::min(a, b);
+}
+
+} // unnamed namespace
+
+// aria2 rate limits can only be set per download, so the global limit is
+// shared equally by the maximum number of active downloads. The limit of the
+// current period of the download schedule (if any) applies too. 0 means no
+// limit.
+int DownloadManager::getDownloadRateLimit() const
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    int rateLimit = settingsMgr->getDownloadRateLimit();
+    if ( !settingsMgr->getDownloadWindows().isEmpty() ) {
+        const int windowRateLimit = isInsideDownloadWindows()
+                                  ? settingsMgr->getDownloadRateLimitInsideWindows()
+                                  : settingsMgr->getDownloadRateLimitOutsideWindows();
+        rateLimit = stricterRateLimit(rateLimit, windowRateLimit);
+    }
+    const int globalRateLimit = settingsMgr->getGlobalDownloadRateLimit();
+    if ( globalRateLimit > 0 ) {
+        const int maxActiveDownloads = settingsMgr->getMaxActiveDownloads();
+        const int share = maxActiveDownloads > 0
+                        ? std::max(1, globalRateLimit / maxActiveDownloads)
+                        : globalRateLimit;
+        rateLimit = stricterRateLimit(rateLimit, share);
+    }
+    return rateLimit;
+}
+
+kiwix::Downloader::Options DownloadManager::getDownloadOptions(const QString& downloadDirPath) const
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    const int rateLimit = getDownloadRateLimit();
+    kiwix::Downloader::Options options;
+    if ( rateLimit > 0 ) {
+        options.push_back({"max-download-limit", std::to_string(rateLimit) + "K"});
+    }
+
+    const QStorageInfo storage(downloadDirPath);
+    const bool preallocate = settingsMgr->getPreallocateDownloads();
+    options.push_back({"file-allocation", getFileAllocationMethod(storage, preallocate)});
+    return options;
+}
+
 void DownloadManager::addRequest(Action action, QString bookId)
 {
-    if ( action == DownloadState::START ) {
+    if ( action == DownloadState::START && !getDownloadState(bookId) ) {
         m_downloads.set(bookId, std::make_shared<DownloadState>());
     }
 
@@ -369,6 +861,61 @@ void DownloadManager::resumeDownload(const QString& bookId)
     auto download = mp_downloader->getDownload(b.getDownloadId());
     if (download->getStatus() == kiwix::Download::K_PAUSED) {
         download->resumeDownload();
+        // the rate limit may have changed while the download was paused
+        applyDownloadOptions(bookId);
+    }
+}
+
+// libkiwix can't change the options of a running download. Instead, the
+// download is removed from aria2 and started again with the current options.
+// aria2 keeps the partially downloaded file and its control file when a
+// download is removed, so the new download resumes from where the old one
+// stopped.
+void DownloadManager::applyDownloadOptions(const QString& bookId)
+{
+    kiwix::Book book;
+    try {
+        book = mp_library->getBookById(bookId);
+    } catch ( const std::out_of_range& ) {
+        return;
+    }
+
+    if ( book.getDownloadId().empty() ) {
+        if ( m_downloadRateLimits.remove(bookId) ) {
+            saveDownloadRateLimits();
+        }
+        return;
+    }
+
+    // The downloads started by an older version of the application have no
+    // known rate limit, they are left alone
+    const int rateLimit = getDownloadRateLimit();
+    if ( !m_downloadRateLimits.contains(bookId) || m_downloadRateLimits[bookId] == rateLimit )
+        return;
+
+    std::shared_ptr<kiwix::Download> download;
+    try {
+        download = mp_downloader->getDownload(book.getDownloadId());
+        download->updateStatus(true);
+    } catch ( ... ) {
+        return; // the download has disappeared (see updateDownload())
+    }
+    const auto status = download->getStatus();
+    const QString downloadPath = QString::fromStdString(download->getPath());
+    if ( (status != kiwix::Download::K_ACTIVE && status != kiwix::Download::K_WAITING)
+         || downloadPath.isEmpty() ) {
+        // paused downloads are handled when they are resumed
+        return;
+    }
+
+    try {
+        download->cancelDownload();
+        const auto downloadDirPath = QFileInfo(downloadPath).absolutePath();
+        setDownloadId(bookId, startDownload(book, downloadDirPath));
+    } catch ( const kiwix::AriaError& ) {
+        // the download has completed in the meantime
+    } catch ( const KiwixAppError& err ) {
+        emit error(err.summary(), err.details());
     }
 }
 
@@ -393,6 +940,9 @@ void DownloadManager::cancelDownload(const QString& bookId)
         // downloadId check above).
         return;
     }
+    if ( m_downloadRateLimits.remove(bookId) ) {
+        saveDownloadRateLimits();
+    }
     emit downloadCancelled(bookId);
 }
 
@@ -5,13 +5,19 @@
 #include <QMap>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
 #include <QString>
 #include <QVariant>
+#include <QVector>
 #include <QWaitCondition>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <iterator>
 #include <memory>
-#include <queue>
 
 #include <kiwix/downloader.h>
 
@@ -19,37 +25,79 @@
 
 typedef QMap<QString, QVariant> DownloadInfo;
 
+// Thread-safe queue of requests. Requests of higher priority (as returned by
+// T::priority()) are dequeued first, requests of the same priority are
+// dequeued in the order in which they were enqueued. A request having the
+// same key (T::key()) as a pending one is merged into the latter, so the
+// depth of the queue is bounded by the number of distinct keys.
 template<class T>
-class ThreadSafePriorityQueue
+class ThreadSafeCoalescingQueue
 {
 public:
-    void enqueue(const T& x)
+    // Returns false if the request was merged into a pending one
+    bool enqueue(const T& x)
     {
         const QMutexLocker threadSafetyGuarantee(&m_mutex);
-        m_queue.push(x);
+        if ( m_pendingKeys.contains(x.key()) ) {
+            ++m_coalescedCount;
+            return false;
+        }
+
+        m_pendingKeys.insert(x.key());
+        m_queues[x.priority()].enqueue(x);
+        m_maxSize = std::max(m_maxSize, size_t(m_pendingKeys.size()));
         m_queueIsNotEmpty.wakeAll();
+        return true;
     }
 
     T dequeue()
     {
         const QMutexLocker threadSafetyGuarantee(&m_mutex);
-        if ( m_queue.empty() )
+        while ( m_queues.isEmpty() )
             m_queueIsNotEmpty.wait(&m_mutex);
 
-        const T ret = m_queue.top();
-        m_queue.pop();
+        const auto highestPriorityQueue = std::prev(m_queues.end());
+        const T ret = highestPriorityQueue->dequeue();
+        if ( highestPriorityQueue->isEmpty() )
+            m_queues.erase(highestPriorityQueue);
+        m_pendingKeys.remove(ret.key());
         return ret;
     }
 
     bool isEmpty() const
     {
         const QMutexLocker threadSafetyGuarantee(&m_mutex);
-        return m_queue.empty();
+        return m_queues.isEmpty();
+    }
+
+    // Queue depth metrics
+
+    size_t size() const
+    {
+        const QMutexLocker threadSafetyGuarantee(&m_mutex);
+        return m_pendingKeys.size();
+    }
+
+    // The largest depth the queue has ever reached
+    size_t maxSize() const
+    {
+        const QMutexLocker threadSafetyGuarantee(&m_mutex);
+        return m_maxSize;
+    }
+
+    // The number of requests that were merged into pending ones
+    size_t coalescedCount() const
+    {
+        const QMutexLocker threadSafetyGuarantee(&m_mutex);
+        return m_coalescedCount;
     }
 
 private: // data
     mutable QMutex  m_mutex;
-    std::priority_queue<T> m_queue;
+    QMap<int, QQueue<T>> m_queues; // by priority, empty queues are removed
+    QSet<typename T::Key> m_pendingKeys;
+    size_t          m_maxSize = 0;
+    size_t          m_coalescedCount = 0;
     QWaitCondition  m_queueIsNotEmpty;
 };
 
@@ -58,6 +106,8 @@ class DownloadState
 public: // types
     enum Action {
         UPDATE,
+        // Restart the download if its options are outdated
+        APPLY_OPTIONS,
         START,
         PAUSE,
         RESUME,
@@ -72,7 +122,8 @@ public: // types
         PAUSE_REQUESTED,
         PAUSED,
         RESUME_REQUESTED,
-        CANCEL_REQUESTED
+        CANCEL_REQUESTED,
+        VERIFYING
     };
 
 public: // data
@@ -80,10 +131,25 @@ public: // data
     double progress = 0;
     QString completedLength;
 
+    // Number of samples in the throughput history
+    static const int SPEED_HISTORY_SIZE = 30;
+
 public: // functions
     void update(const DownloadInfo& info);
     QString getDownloadSpeed() const;
+    // Estimated remaining time (based on the smoothed download speed)
+    QString getEstimatedTimeLeft() const;
+    // The most recent download speeds (in bytes per second) starting with
+    // the oldest one
+    QVector<double> getSpeedHistory() const;
     Status getStatus() const { return status; }
+
+    // The download is waiting in our queue (it hasn't been passed to aria2 yet)
+    void markAsWaiting() { status = WAITING; }
+
+    // aria2 has completed the download and the file is being verified (the
+    // progress refers to the verification from now on)
+    void markAsVerifying() { status = VERIFYING; progress = 0; }
     void changeState(Action action);
     bool stateChangeHasBeenRequested() const
     {
@@ -98,7 +164,14 @@ public: // functions
 
 private: // data
     Status status = UNKNOWN;
-    QString downloadSpeed;
+    // Exponentially weighted moving average of the download speed (in bytes
+    // per second), negative until the first update
+    double smoothedSpeed = -1;
+    double remainingBytes = 0;
+    // Ring buffer of download speeds
+    std::array<double, SPEED_HISTORY_SIZE> speedHistory;
+    int speedHistoryStart = 0;
+    int speedHistoryLength = 0;
     std::chrono::steady_clock::time_point lastUpdated;
 };
 
@@ -155,10 +228,25 @@ public: // functions
     void restoreDownloads();
 
     void addRequest(Action action, QString bookId);
+    void resumeDownloadAtUserRequest(QString bookId);
+
+    // The download of the book is queued and started once fewer downloads
+    // than the configured maximum are active
+    void scheduleDownload(QString bookId);
+    bool isQueued(QString bookId) const { return m_queuedDownloads.contains(bookId); }
+    // Returns false if the download has already been started
+    bool cancelQueuedDownload(QString bookId);
+    // Used when the queue is ordered by user priority (higher first)
+    void setDownloadPriority(QString bookId, int priority);
+    int getHighestDownloadPriority() const;
+    // Applies the changed download settings to the queue and to the running
+    // downloads
+    void applyDownloadSettings();
 
     // Throws a KiwixAppError in case of any foreseeable problem preventing a
-    // successful download
-    void checkThatBookCanBeDownloaded(const kiwix::Book& book, const QString& downloadDirPath);
+    // successful download. reservedBytes of the free space are considered
+    // already taken (see getQueuedDownloadsSize()).
+    void checkThatBookCanBeDownloaded(const kiwix::Book& book, const QString& downloadDirPath, uint64_t reservedBytes = 0);
 
     void removeDownload(QString bookId);
 
@@ -177,25 +265,52 @@ protected:
     // returns the download id
     std::string startDownload(const kiwix::Book& book, const QString& downloadDirPath);
 
+    // Whether the progress of the downloads is being displayed (and
+    // therefore has to be updated more frequently)
+    virtual bool downloadsAreBeingWatched() const { return true; }
+
+    // Called (in the download updater thread) when a download has been
+    // restarted in aria2 under a new id
+    virtual void setDownloadId(QString bookId, std::string downloadId) = 0;
+
+    void startQueuedDownloads();
+    // The total size of the queued books to be saved on the same volume as
+    // downloadDirPath
+    uint64_t getQueuedDownloadsSize(const QString& downloadDirPath) const;
+
 private: // types
     struct Request
     {
+        typedef QPair<int, QString> Key;
+
         Action  action;
         QString bookId;
 
-        bool operator<(const Request& other) const {
-            return this->action < other.action;
-        }
+        // The order of the actions defines their priorities
+        int priority() const { return action; }
+        Key key() const { return {action, bookId}; }
     };
 
-    typedef ThreadSafePriorityQueue<Request> RequestQueue;
+    typedef ThreadSafeCoalescingQueue<Request> RequestQueue;
 
 private: // functions
     void processDownloadActions();
+    void logRequestQueueMetrics() const;
     virtual void startDownload(QString bookId) = 0;
     void pauseDownload(const QString& bookId);
     void resumeDownload(const QString& bookId);
+    void applyDownloadOptions(const QString& bookId);
     void updateDownload(QString bookId);
+    void updateAllDownloads();
+    bool downloadHasBeenStarted(const QString& bookId) const;
+    void applyDownloadSchedule();
+    void saveDownloadSchedule() const;
+    void saveDownloadRateLimits() const;
+    QString takeNextQueuedDownload();
+    void saveDownloadQueue() const;
+    void restoreDownloadQueue();
+    int getDownloadRateLimit() const;
+    kiwix::Downloader::Options getDownloadOptions(const QString& downloadDirPath) const;
     void cancelDownload(const QString& bookId);
 
 private: // data
@@ -204,6 +319,23 @@ private: // data
     Downloads                m_downloads;
     QThread*                 mp_downloadUpdaterThread = nullptr;
     RequestQueue             m_requestQueue;
+
+    // Downloads not started yet in the order in which they were scheduled
+    // (used from the main thread only)
+    QStringList              m_queuedDownloads;
+    QMap<QString, int>       m_downloadPriorities;
+
+    // Downloads paused automatically outside the download time windows
+    // (used from the main thread only)
+    QSet<QString>            m_downloadsPausedBySchedule;
+    // Downloads resumed by the user outside the download time windows (used
+    // from the main thread only)
+    QSet<QString>            m_downloadsResumedByUser;
+    bool                     m_wasInsideDownloadWindows = true;
+
+    // Rate limits (in KiB/s) with which the downloads were started in aria2
+    // (used from the download updater thread only, saved across restarts)
+    QMap<QString, int>       m_downloadRateLimits;
 };
 
 #endif // DOWNLOADMANAGEMENT_H
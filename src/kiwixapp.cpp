@@ -124,6 +124,9 @@ void KiwixApp::setupDirectoryMonitoring()
     QString monitorDir = m_settingsManager.getMonitorDir();
     QString downloadDir = m_settingsManager.getDownloadDir();
     auto dirList = QSet<QString>({monitorDir, downloadDir});
+    for (const auto& dir : m_settingsManager.getExtraMonitorDirs()) {
+        dirList.insert(dir);
+    }
     mp_manager->setMonitoredDirectories(dirList);
 }
 
@@ -317,18 +320,12 @@ QAction *KiwixApp::getAction(KiwixApp::Actions action)
 
 bool KiwixApp::isCurrentArticleBookmarked()
 {
-    auto zimId = getTabWidget()->currentZimId().toStdString();
-    if (zimId.empty()) {
+    auto zimId = getTabWidget()->currentZimId();
+    if (zimId.isEmpty()) {
         return false;
     }
-    auto url = getTabWidget()->currentArticleUrl().toStdString();
-
-    for (auto& bookmark: getLibrary()->getBookmarks()) {
-        if (bookmark.getBookId() == zimId && bookmark.getUrl() == url) {
-            return true;
-        }
-    }
-    return false;
+    auto url = getTabWidget()->currentArticleUrl();
+    return getLibrary()->isBookmarked(zimId, url);
 }
 
 void KiwixApp::setMonitorDir(const QString &dir) {
@@ -502,6 +499,8 @@ void KiwixApp::postInit() {
             this, &KiwixApp::handleItemsState);
     emit(m_library.booksChanged());
     connect(&m_library, &Library::booksChanged, this, &KiwixApp::updateNameMapper);
+    connect(&m_settingsManager, &SettingsManager::extraMonitorDirsChanged,
+            this, &KiwixApp::setupDirectoryMonitoring);
     handleItemsState(TabType::LibraryTab);
 }
 
@@ -18,6 +18,7 @@ class LibraryManipulator: public kiwix::LibraryManipulator {
     virtual ~LibraryManipulator() {}
     bool addBookToLibrary(kiwix::Book book) {
         auto ret = mp_library->mp_library->addBook(book);
+        mp_library->indexBook(QString::fromStdString(book.getId()));
         emit(mp_library->booksChanged());
         return ret;
     }
@@ -34,6 +35,7 @@ Library::Library(const QString& libraryDirectory)
     auto manager = kiwix::Manager(LibraryManipulator(this));
     manager.readFile(kiwix::appendToDirectory(m_libraryDirectory.toStdString(),"library.xml"), false);
     manager.readBookmarkFile(kiwix::appendToDirectory(m_libraryDirectory.toStdString(),"library.bookmarks.xml"));
+    rebuildBookmarkIndex();
     emit(booksChanged());
 }
 
@@ -54,6 +56,7 @@ QString Library::openBookFromPath(const QString &zimPath)
     if (id == "") {
         throw std::invalid_argument("invalid zim file");
     }
+    indexBook(QString::fromStdString(id));
     save();
     emit(booksChanged());
     return QString::fromStdString(id);
@@ -73,6 +76,37 @@ std::shared_ptr<zim::Searcher> Library::getSearcher(const QString &zimId)
     return mp_library->getSearcherById(zimId.toStdString());
 }
 
+// Passes the suggestions for prefix in the ZIM file zimId (starting with the
+// suggestion at index start) to f. The suggestion searcher of every ZIM file
+// is kept, as well as its search for the most recent prefix, so that fetching
+// more suggestions doesn't repeat the whole query.
+void Library::getSuggestions(const QString& zimId, const QString& prefix, int start, int count,
+                             const std::function<void(const zim::SuggestionItem&)>& f)
+{
+    const auto archive = getArchive(zimId);
+    std::shared_ptr<SuggestionSession> sessionPtr;
+    {
+        const QMutexLocker locker(&m_suggestionSessionsMutex);
+        auto& entry = m_suggestionSessions[zimId];
+        if ( !entry ) {
+            entry = std::make_shared<SuggestionSession>();
+        }
+        sessionPtr = entry;
+    }
+    SuggestionSession& session = *sessionPtr;
+    const QMutexLocker locker(&session.mutex);
+    if ( !session.searcher ) {
+        session.searcher = std::make_shared<zim::SuggestionSearcher>(*archive);
+    }
+    if ( !session.search || session.prefix != prefix ) {
+        session.search = std::make_shared<zim::SuggestionSearch>(session.searcher->suggest(prefix.toStdString()));
+        session.prefix = prefix;
+    }
+    for (const auto& suggestion : session.search->getResults(start, count)) {
+        f(suggestion);
+    }
+}
+
 QIcon Library::getBookIcon(const QString &zimId)
 {
     static QIcon defaultIcon = QIcon(":/icons/placeholder-icon.png");
@@ -111,13 +145,28 @@ QStringList Library::listBookIds(const kiwix::Filter& filter, kiwix::supportedLi
     return list;
 }
 
-void Library::addBookToLibrary(kiwix::Book &book)
+void Library::addBookToLibrary(const kiwix::Book &book)
 {
     mp_library->addBook(book);
+    indexBook(QString::fromStdString(book.getId()));
+}
+
+void Library::addOrUpdateBook(const kiwix::Book& book)
+{
+    mp_library->addOrUpdateBook(book);
+    indexBook(QString::fromStdString(book.getId()));
 }
 
 void Library::removeBookFromLibraryById(const QString& id) {
     mp_library->removeBookById(id.toStdString());
+    {
+        const QMutexLocker locker(&m_searchIndexMutex);
+        m_searchIndex.removeBook(id);
+    }
+
+    // don't keep the ZIM file open
+    const QMutexLocker locker(&m_suggestionSessionsMutex);
+    m_suggestionSessions.remove(id);
 }
 
 namespace
@@ -198,15 +247,56 @@ bool Library::isBeingDownloadedByUs(QString path) const
 void Library::addBookmark(kiwix::Bookmark &bookmark)
 {
     mp_library->addBookmark(bookmark);
+    const BookmarkKey key(QString::fromStdString(bookmark.getBookId()),
+                          QString::fromStdString(bookmark.getUrl()));
+    m_bookmarkIndex.insert(key);
     emit bookmarksChanged();
 }
 
 void Library::removeBookmark(const QString &zimId, const QString &url)
 {
     mp_library->removeBookmark(zimId.toStdString(), url.toStdString());
+    m_bookmarkIndex.remove(BookmarkKey(zimId, url));
     emit bookmarksChanged();
 }
 
+// Makes the bookmarks of a book point to another book (e.g. a newer version
+// of the same content)
+void Library::moveBookmarks(const QString& fromZimId, const kiwix::Book& toBook)
+{
+    bool moved = false;
+    for (const auto& bookmark : mp_library->getBookmarks()) {
+        if ( bookmark.getBookId() != fromZimId.toStdString() )
+            continue;
+
+        kiwix::Bookmark movedBookmark(bookmark);
+        movedBookmark.setBookId(toBook.getId());
+        movedBookmark.setBookTitle(toBook.getTitle());
+        mp_library->removeBookmark(bookmark.getBookId(), bookmark.getUrl());
+        mp_library->addBookmark(movedBookmark);
+        moved = true;
+    }
+    if ( moved ) {
+        rebuildBookmarkIndex();
+        emit bookmarksChanged();
+    }
+}
+
+bool Library::isBookmarked(const QString &zimId, const QString &url) const
+{
+    return m_bookmarkIndex.contains(BookmarkKey(zimId, url));
+}
+
+void Library::rebuildBookmarkIndex()
+{
+    m_bookmarkIndex.clear();
+    for (const auto& bookmark : mp_library->getBookmarks()) {
+        const BookmarkKey key(QString::fromStdString(bookmark.getBookId()),
+                              QString::fromStdString(bookmark.getUrl()));
+        m_bookmarkIndex.insert(key);
+    }
+}
+
 void Library::save()
 {
     mp_library->writeToFile(kiwix::appendToDirectory(m_libraryDirectory.toStdString(),"library.xml"));
@@ -228,12 +318,45 @@ Library::QStringSet Library::getLibraryZimsFromDir(QString dir) const
     return zimsInDir;
 }
 
+// Same as getLibraryZimsFromDir() for all directories at once (the keys are
+// absolute paths with native separators)
+QMap<QString, Library::QStringSet> Library::getLibraryZimsByDir() const
+{
+    QMap<QString, QStringSet> zimsByDir;
+    for (auto str : getBookIds()) {
+        auto filePath = QString::fromStdString(getBookById(str).getPath());
+        if ( filePath.endsWith(BEINGDOWNLOADEDSUFFIX) )
+                continue;
+        const QFileInfo fileInfo(filePath);
+        zimsByDir[QDir::toNativeSeparators(fileInfo.absolutePath())].insert(fileInfo.fileName());
+    }
+    return zimsByDir;
+}
+
+// The book is (re)indexed as stored in mp_library
+void Library::indexBook(const QString& id)
+{
+    const QMutexLocker locker(&m_searchIndexMutex);
+    try {
+        m_searchIndex.addBook(mp_library->getBookById(id.toStdString()));
+    } catch ( const std::out_of_range& ) {
+        // the book was removed in the meantime
+    }
+}
+
+QSet<QString> Library::searchBooks(const QString& query) const
+{
+    const QMutexLocker locker(&m_searchIndexMutex);
+    return m_searchIndex.search(query);
+}
+
 bool Library::readBookMarksFile(const std::string &filename)
 {
     kiwix::Manager manager(mp_library);
     if (!manager.readBookmarkFile(filename))
         return false;
 
+    rebuildBookmarkIndex();
     emit bookmarksChanged();
     return true;
 }
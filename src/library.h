@@ -5,15 +5,21 @@
 #include <kiwix/library.h>
 #include <zim/archive.h>
 #include <zim/search.h>
+#include <zim/suggestion.h>
 #include <qstring.h>
 #include <memory>
+#include <functional>
 
 #include <QObject>
 #include <QSharedPointer>
 #include <QMap>
+#include <QSet>
+#include <QPair>
 #include <QMutex>
 #include <QIcon>
 
+#include "booksearchindex.h"
+
 #define TQS(v) (QString::fromStdString(v))
 #define FORWARD_GETTER(METH) QString METH() const { return TQS(mp_book->METH()); }
 
@@ -34,12 +40,19 @@ public:
     QString openBookFromPath(const QString& zimPath);
     std::shared_ptr<zim::Archive> getArchive(const QString& zimId);
     std::shared_ptr<zim::Searcher> getSearcher(const QString& zimId);
+    void getSuggestions(const QString& zimId, const QString& prefix, int start, int count,
+                        const std::function<void(const zim::SuggestionItem&)>& f);
     QIcon getBookIcon(const QString& zimId);
     QStringList getBookIds() const;
     QStringList listBookIds(const kiwix::Filter& filter, kiwix::supportedListSortBy sortBy, bool ascending) const;
     const std::vector<kiwix::Bookmark> getBookmarks(bool onlyValidBookmarks = false) const { return mp_library->getBookmarks(onlyValidBookmarks); }
+    bool isBookmarked(const QString& zimId, const QString& url) const;
+    // Ids of the books matching query (see BookSearchIndex::search())
+    QSet<QString> searchBooks(const QString& query) const;
     QStringSet getLibraryZimsFromDir(QString dir) const;
-    void addBookToLibrary(kiwix::Book& book);
+    QMap<QString, QStringSet> getLibraryZimsByDir() const;
+    void addBookToLibrary(const kiwix::Book& book);
+    void addOrUpdateBook(const kiwix::Book& book);
     void addBookBeingDownloaded(const kiwix::Book& book, QString downloadDir);
     bool isBeingDownloadedByUs(QString path) const;
     void updateBookBeingDownloaded(const QString& bookId, const QString& bookPath);
@@ -47,6 +60,7 @@ public:
     void removeBookFromLibraryById(const QString& id);
     void addBookmark(kiwix::Bookmark& bookmark);
     void removeBookmark(const QString& zimId, const QString& url);
+    void moveBookmarks(const QString& fromZimId, const kiwix::Book& toBook);
     bool readBookMarksFile(const std::string& filename);
     void save();
     kiwix::LibraryPtr getKiwixLibrary() { return mp_library; }
@@ -58,8 +72,30 @@ signals:
     void bookmarksChanged();
 
 private:
+    typedef QPair<QString, QString> BookmarkKey;
+    void rebuildBookmarkIndex();
+    void indexBook(const QString& id);
+
+    // The suggestion searcher of a ZIM file and its most recent search
+    struct SuggestionSession
+    {
+        QMutex mutex;
+        std::shared_ptr<zim::SuggestionSearcher> searcher;
+        QString prefix;
+        std::shared_ptr<zim::SuggestionSearch> search;
+    };
+
     kiwix::LibraryPtr mp_library;
     QString m_libraryDirectory;
+    // The (book id, url) of the bookmarks of mp_library, so that membership
+    // queries don't have to copy and scan the whole vector.
+    QSet<BookmarkKey> m_bookmarkIndex;
+    QMutex m_suggestionSessionsMutex; // only guards the map itself
+    QMap<QString, std::shared_ptr<SuggestionSession>> m_suggestionSessions; // by book id
+    // Kept up to date by the functions adding books to and removing them
+    // from mp_library
+    mutable QMutex m_searchIndexMutex;
+    BookSearchIndex m_searchIndex;
 friend class LibraryManipulator;
 };
 
@@ -1,6 +1,232 @@
 #include "opdsrequestmanager.h"
 #include "kiwixapp.h"
 
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSaveFile>
+#include <QSettings>
+
+#include <memory>
+
+namespace
+{
+
+// Splits an OPDS feed arriving in chunks into self-contained feeds, each
+// made of the header of the original feed and a batch of its entries. The
+// batches grow in size so that the first books can be shown quickly while
+// the number of batches for a large catalog stays small.
+class OpdsFeedSplitter
+{
+public:
+    QList<QByteArray> addData(const QByteArray& data);
+
+    // Returns the feed with the remaining entries (if any)
+    QByteArray finish();
+
+    // Number of entries passed so far
+    int totalEntryCount() const { return m_totalEntryCount; }
+
+    // Number of entries matching the request, as announced by the feed
+    // (-1 if it isn't known)
+    int totalResults() const;
+
+private:
+    QByteArray makeFeed();
+
+private:
+    static const int FIRST_BATCH_SIZE = 50;
+    static const int MAX_BATCH_SIZE = 2000;
+
+    QByteArray m_buffer;  // received data not consumed yet
+    QByteArray m_header;  // everything preceding the first entry
+    bool m_headerComplete = false;
+    QByteArray m_entries; // complete entries of the current batch
+    int m_entryCount = 0;
+    int m_totalEntryCount = 0;
+    int m_batchSize = FIRST_BATCH_SIZE;
+};
+
+int findEntryStart(const QByteArray& data, int from)
+{
+    const QByteArray tag("<entry");
+    for (int pos = data.indexOf(tag, from); pos >= 0; pos = data.indexOf(tag, pos + 1)) {
+        const int next = pos + tag.size();
+        if ( next >= data.size() )
+            return -1; // can't tell yet
+        const char c = data[next];
+        if ( c == '>' || c == ' ' || c == '\n' || c == '\r' || c == '\t' )
+            return pos;
+    }
+    return -1;
+}
+
+QList<QByteArray> OpdsFeedSplitter::addData(const QByteArray& data)
+{
+    QList<QByteArray> batches;
+    m_buffer.append(data);
+    if ( !m_headerComplete ) {
+        const int firstEntryStart = findEntryStart(m_buffer, 0);
+        if ( firstEntryStart < 0 )
+            return batches;
+
+        m_header = m_buffer.left(firstEntryStart);
+        m_buffer.remove(0, firstEntryStart);
+        m_headerComplete = true;
+    }
+
+    const QByteArray endTag("</entry>");
+    int consumed = 0;
+    for (int start = findEntryStart(m_buffer, 0); start >= 0; start = findEntryStart(m_buffer, consumed)) {
+        const int end = m_buffer.indexOf(endTag, start);
+        if ( end < 0 )
+            break;
+
+        consumed = end + endTag.size();
+        m_entries.append(m_buffer.constData() + start, consumed - start);
+        ++m_totalEntryCount;
+        if ( ++m_entryCount == m_batchSize ) {
+            batches.append(makeFeed());
+            m_batchSize = std::min(2 * m_batchSize, int(MAX_BATCH_SIZE));
+        }
+    }
+    m_buffer.remove(0, consumed);
+    return batches;
+}
+
+QByteArray OpdsFeedSplitter::finish()
+{
+    if ( !m_headerComplete ) {
+        // a feed without entries
+        return m_buffer;
+    }
+    return m_entryCount != 0 ? makeFeed() : QByteArray();
+}
+
+int OpdsFeedSplitter::totalResults() const
+{
+    // A feed without entries is only available from m_buffer
+    const QByteArray& header = m_headerComplete ? m_header : m_buffer;
+    const QByteArray tag("<totalResults>");
+    const int tagPos = header.indexOf(tag);
+    if ( tagPos < 0 )
+        return -1;
+
+    const int valueStart = tagPos + tag.size();
+    const int valueEnd = header.indexOf('<', valueStart);
+    if ( valueEnd < 0 )
+        return -1;
+
+    bool ok = false;
+    const int value = header.mid(valueStart, valueEnd - valueStart).trimmed().toInt(&ok);
+    return ok ? value : -1;
+}
+
+QByteArray OpdsFeedSplitter::makeFeed()
+{
+    QByteArray feed = m_header + m_entries + "</feed>";
+    m_entries.clear();
+    m_entryCount = 0;
+    return feed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// On-disk cache of catalog responses
+////////////////////////////////////////////////////////////////////////////////
+
+// Every language and category filter makes a different URL. Only the
+// responses used most recently are kept.
+const int MAX_CACHED_RESPONSES = 50;
+
+QString getCacheDirectory()
+{
+    static const QString cacheDir = []() {
+        const QString dir = getDataDirectory() + "/catalog-cache";
+        QDir().mkpath(dir);
+        return dir;
+    }();
+    return cacheDir;
+}
+
+// Every cached response is stored in a file named after the hash of its URL,
+// along with an .ini file holding the validators (ETag and Last-Modified) to
+// be sent when the response is revalidated.
+QString getCacheFilePath(const QUrl& url, const QString& extension)
+{
+    const QByteArray urlHash = QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha1).toHex();
+    return getCacheDirectory() + "/" + QString::fromLatin1(urlHash) + extension;
+}
+
+// Returns a null QByteArray if there is no cached response for url
+QByteArray readCachedResponse(const QUrl& url)
+{
+    QFile file(getCacheFilePath(url, ".xml"));
+    if ( !QFileInfo::exists(getCacheFilePath(url, ".ini")) || !file.open(QIODevice::ReadWrite) )
+        return QByteArray();
+
+    // The modification time of a response tells when it was last used (see
+    // pruneCache())
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return file.readAll();
+}
+
+// Removes the responses that were used least recently
+void pruneCache()
+{
+    const QDir cacheDir(getCacheDirectory());
+    const auto responseFiles = cacheDir.entryInfoList({"*.xml"}, QDir::Files, QDir::Time);
+    for (int i = MAX_CACHED_RESPONSES; i < responseFiles.size(); ++i) {
+        QFile::remove(cacheDir.filePath(responseFiles[i].completeBaseName() + ".ini"));
+        QFile::remove(responseFiles[i].absoluteFilePath());
+    }
+}
+
+void addCacheValidators(QNetworkRequest& request)
+{
+    const QSettings validators(getCacheFilePath(request.url(), ".ini"), QSettings::IniFormat);
+    const QByteArray etag = validators.value("ETag").toByteArray();
+    const QByteArray lastModified = validators.value("Last-Modified").toByteArray();
+    if ( !etag.isEmpty() )
+        request.setRawHeader("If-None-Match", etag);
+    if ( !lastModified.isEmpty() )
+        request.setRawHeader("If-Modified-Since", lastModified);
+}
+
+// Must be called after the content of the response has been saved
+void saveCacheValidators(QNetworkReply* reply)
+{
+    QSettings validators(getCacheFilePath(reply->url(), ".ini"), QSettings::IniFormat);
+    validators.setValue("ETag", reply->rawHeader("ETag"));
+    validators.setValue("Last-Modified", reply->rawHeader("Last-Modified"));
+}
+
+bool isNotModified(QNetworkReply* reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304;
+}
+
+bool isSuccessful(QNetworkReply* reply)
+{
+    return reply->error() == QNetworkReply::NoError && !isNotModified(reply);
+}
+
+// State of a catalog request
+struct CatalogResponse
+{
+    explicit CatalogResponse(const QUrl& url)
+        : cacheFile(getCacheFilePath(url, ".xml"))
+    {}
+
+    OpdsFeedSplitter feedSplitter;
+    QSaveFile cacheFile;
+
+    // The catalog has already been delivered from the cache. If the cached
+    // copy turns out to be outdated, the new catalog is delivered in full
+    // once it is downloaded rather than batch by batch.
+    bool deliveredFromCache = false;
+};
+
+} // unnamed namespace
+
 OpdsRequestManager::OpdsRequestManager()
 {
 }
@@ -21,7 +247,7 @@ int OpdsRequestManager::getCatalogPort()
          : 443;
 }
 
-void OpdsRequestManager::doUpdate(const QString& currentLanguage, const QString& categoryFilter)
+void OpdsRequestManager::doUpdate(const QString& currentLanguage, const QString& categoryFilter, const QString& searchQuery, int start, int count)
 {
     QUrlQuery query;
 
@@ -33,21 +259,88 @@ void OpdsRequestManager::doUpdate(const QString& currentLanguage, const QString&
         query.addQueryItem("lang", currentLanguage);
     }
 
-    // Request all results (no pagination)
-    query.addQueryItem("count", QString::number(-1));
+    // Request one page of results (or all of them)
+    query.addQueryItem("start", QString::number(start));
+    query.addQueryItem("count", QString::number(count));
 
     // Add filter by category (if necessary)
     if (categoryFilter != "") {
         query.addQueryItem("category", categoryFilter);
     }
 
-    auto mp_reply = opdsResponseFromPath("/catalog/search", query);
+    // Add the text query (if necessary)
+    if (searchQuery != "") {
+        query.addQueryItem("q", searchQuery);
+    }
+
+    // Only the latest catalog request is of interest
+    if ( mp_catalogReply )
+        mp_catalogReply->abort();
+
+    const QUrl url = getCatalogUrl("/catalog/search", query);
+    const auto response = std::make_shared<CatalogResponse>(url);
+
+    // Show the cached catalog right away and revalidate it in the background.
+    // Only the first page of the unsearched catalog is cached, it is the one
+    // needed to open the catalog quickly.
+    const bool useCache = (start == 0 && searchQuery == "");
+    const QByteArray cachedFeed = useCache ? readCachedResponse(url) : QByteArray();
+    if ( !cachedFeed.isNull() ) {
+        response->deliveredFromCache = true;
+        for (const auto& batch : response->feedSplitter.addData(cachedFeed)) {
+            emit(requestBatchReceived(batch));
+        }
+        const QByteArray lastBatch = response->feedSplitter.finish();
+        if (!lastBatch.isEmpty()) {
+            emit(requestBatchReceived(lastBatch));
+        }
+    }
+
+    auto mp_reply = sendRequest(url, !cachedFeed.isNull());
+    mp_catalogReply = mp_reply;
+    const auto receiveData = [=]() {
+        if ( !isSuccessful(mp_reply) )
+            return;
+        const QByteArray data = mp_reply->readAll();
+        if ( useCache && !response->cacheFile.isOpen() )
+            response->cacheFile.open(QIODevice::WriteOnly);
+        if ( response->cacheFile.isOpen() )
+            response->cacheFile.write(data);
+        if ( !response->deliveredFromCache ) {
+            for (const auto& batch : response->feedSplitter.addData(data)) {
+                emit(requestBatchReceived(batch));
+            }
+        }
+    };
+    connect(mp_reply, &QNetworkReply::readyRead, this, receiveData);
     connect(mp_reply, &QNetworkReply::finished, this, [=]() {
-        receiveContent(mp_reply);
+        if (mp_reply->error() != QNetworkReply::OperationCanceledError) {
+            receiveData();
+            if (isSuccessful(mp_reply) && response->cacheFile.isOpen() && response->cacheFile.commit()) {
+                saveCacheValidators(mp_reply);
+                pruneCache();
+            }
+
+            if (!response->deliveredFromCache) {
+                const QByteArray lastBatch = response->feedSplitter.finish();
+                if (!lastBatch.isEmpty()) {
+                    emit(requestBatchReceived(lastBatch));
+                }
+            } else if (isSuccessful(mp_reply)) {
+                emit(requestRefreshed(readCachedResponse(url)));
+            }
+            const int receivedEntryCount = response->feedSplitter.totalEntryCount();
+            const int totalResults = response->feedSplitter.totalResults();
+            const bool morePagesAvailable = totalResults >= 0
+                                          ? start + receivedEntryCount < totalResults
+                                          : count != -1 && receivedEntryCount == count;
+            emit(requestCompleted(morePagesAvailable));
+        }
+        mp_reply->deleteLater();
     });
 }
 
-QNetworkReply* OpdsRequestManager::opdsResponseFromPath(const QString &path, const QUrlQuery &query)
+QUrl OpdsRequestManager::getCatalogUrl(const QString &path, const QUrlQuery &query)
 {
     QUrl url;
     const int port = getCatalogPort();
@@ -56,49 +349,75 @@ QNetworkReply* OpdsRequestManager::opdsResponseFromPath(const QString &path, con
     url.setPort(port);
     url.setPath(path);
     url.setQuery(query);
+    return url;
+}
+
+QNetworkReply* OpdsRequestManager::sendRequest(const QUrl &url, bool revalidateCachedResponse)
+{
     qInfo() << "Downloading" << url.toString(QUrl::FullyEncoded);
     QNetworkRequest request(url);
+    if (revalidateCachedResponse) {
+        addCacheValidators(request);
+    }
     return m_networkManager.get(request);
 }
 
-void OpdsRequestManager::getLanguagesFromOpds()
+// Small documents (such as the lists of languages and categories) are
+// delivered from the cache first and once more if the cached copy was
+// outdated.
+void OpdsRequestManager::getCachedDocument(const QString &path, void (OpdsRequestManager::*received)(const QString&))
 {
-    auto mp_reply = opdsResponseFromPath("/catalog/v2/languages");
-    connect(mp_reply, &QNetworkReply::finished, this, [=]() {
-        receiveLanguages(mp_reply);
-    });
-}
+    const QUrl url = getCatalogUrl(path);
+    const QByteArray cachedContent = readCachedResponse(url);
+    if ( !cachedContent.isNull() ) {
+        emit((this->*received)(QString::fromUtf8(cachedContent)));
+    }
 
-void OpdsRequestManager::getCategoriesFromOpds()
-{
-    auto mp_reply = opdsResponseFromPath("/catalog/v2/categories");
+    auto mp_reply = sendRequest(url, !cachedContent.isNull());
     connect(mp_reply, &QNetworkReply::finished, this, [=]() {
-        receiveCategories(mp_reply);
+        if ( isSuccessful(mp_reply) ) {
+            const QByteArray content = mp_reply->readAll();
+            QSaveFile cacheFile(getCacheFilePath(url, ".xml"));
+            if ( cacheFile.open(QIODevice::WriteOnly) ) {
+                cacheFile.write(content);
+                if ( cacheFile.commit() ) {
+                    saveCacheValidators(mp_reply);
+                    pruneCache();
+                }
+            }
+            emit((this->*received)(QString::fromUtf8(content)));
+        } else if ( cachedContent.isNull() && mp_reply->error() != QNetworkReply::OperationCanceledError ) {
+            emit((this->*received)(QString()));
+        }
+        mp_reply->deleteLater();
     });
 }
 
-QString replyContent(QNetworkReply *mp_reply)
+void OpdsRequestManager::getLanguagesFromOpds()
 {
-    QString content;
-    if (mp_reply->error() != QNetworkReply::OperationCanceledError) {
-        content = mp_reply->readAll().data();
-    }
-    mp_reply->deleteLater();
-    mp_reply = nullptr;
-    return content;
+    getCachedDocument("/catalog/v2/languages", &OpdsRequestManager::languagesReceived);
 }
 
-void OpdsRequestManager::receiveLanguages(QNetworkReply *mp_reply)
+void OpdsRequestManager::getCategoriesFromOpds()
 {
-    emit(languagesReceived(replyContent(mp_reply)));
+    getCachedDocument("/catalog/v2/categories", &OpdsRequestManager::categoriesReceived);
 }
 
-void OpdsRequestManager::receiveCategories(QNetworkReply *mp_reply)
+// Unlike the catalog requests, these requests are neither paged nor cached
+// and don't abort each other.
+void OpdsRequestManager::getBooksByName(const QString& name)
 {
-    emit(categoriesReceived(replyContent(mp_reply)));
-}
+    QUrlQuery query;
+    query.addQueryItem("name", name);
+    query.addQueryItem("count", "-1");
 
-void OpdsRequestManager::receiveContent(QNetworkReply *mp_reply)
-{
-    emit(requestReceived(replyContent(mp_reply)));
+    auto mp_reply = sendRequest(getCatalogUrl("/catalog/search", query), false);
+    connect(mp_reply, &QNetworkReply::finished, this, [=]() {
+        if ( isSuccessful(mp_reply) ) {
+            emit(booksByNameReceived(name, mp_reply->readAll(), QString()));
+        } else {
+            emit(booksByNameReceived(name, QByteArray(), mp_reply->errorString()));
+        }
+        mp_reply->deleteLater();
+    });
 }
@@ -15,23 +15,36 @@ public:
     ~OpdsRequestManager() {}
 
 public:
-    void doUpdate(const QString& currentLanguage, const QString& categoryFilter);
+    // Number of catalog entries requested at once
+    static const int CATALOG_PAGE_SIZE = 100;
+
+    // Requests count entries of the catalog (matching searchQuery if it isn't
+    // empty) starting at entry start (all the remaining entries if count is -1)
+    void doUpdate(const QString& currentLanguage, const QString& categoryFilter, const QString& searchQuery, int start = 0, int count = CATALOG_PAGE_SIZE);
     void getLanguagesFromOpds();
     void getCategoriesFromOpds();
+    // Requests all the versions of the book with the given name
+    void getBooksByName(const QString& name);
 
 private:
     QNetworkAccessManager m_networkManager;
-    QNetworkReply* opdsResponseFromPath(const QString &path, const QUrlQuery &query = QUrlQuery());
+    QPointer<QNetworkReply> mp_catalogReply;
+    static QUrl getCatalogUrl(const QString &path, const QUrlQuery &query = QUrlQuery());
+    QNetworkReply* sendRequest(const QUrl &url, bool revalidateCachedResponse);
+    void getCachedDocument(const QString &path, void (OpdsRequestManager::*received)(const QString&));
 
 signals:
-    void requestReceived(const QString&);
+    // The catalog is delivered in batches as it is being downloaded. Every
+    // batch is a self-contained OPDS feed.
+    void requestBatchReceived(const QByteArray&);
+    // A more recent catalog than the one delivered from the cache was
+    // received. It replaces the catalog delivered so far.
+    void requestRefreshed(const QByteArray&);
+    void requestCompleted(bool morePagesAvailable);
     void languagesReceived(const QString&);
     void categoriesReceived(const QString&);
-
-public slots:
-    void receiveContent(QNetworkReply*);
-    void receiveLanguages(QNetworkReply*);
-    void receiveCategories(QNetworkReply*);
+    // opdsFeed is null (and errorString is set) if the request failed
+    void booksByNameReceived(const QString& name, const QByteArray& opdsFeed, const QString& errorString);
 
 public:
     static QString getCatalogHost();
@@ -2,24 +2,48 @@
 #include <QVariant>
 #include "kiwixapp.h"
 #include "descriptionnode.h"
+#include <kiwix/tools.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // RowNode
 ////////////////////////////////////////////////////////////////////////////////
 
-RowNode::RowNode(QList<QVariant> itemData, QString bookId, std::weak_ptr<RowNode> parent)
-    : m_itemData(itemData), m_parentItem(parent), m_bookId(bookId)
+RowNode::RowNode(BookRecord record, std::weak_ptr<RowNode> parent)
+    : m_record(record), m_parentItem(parent)
 {
 }
 
 RowNode::~RowNode()
 {}
 
+void RowNode::setIconData(QByteArray iconData)
+{
+    m_record.faviconData = iconData;
+    m_icon = QIcon();
+}
+
+void RowNode::setRecord(const BookRecord& record)
+{
+    if ( record.faviconData != m_record.faviconData )
+        m_icon = QIcon();
+    m_record = record;
+}
+
 void RowNode::appendChild(std::shared_ptr<Node> item)
 {
     m_childItems.append(item);
 }
 
+void RowNode::insertChild(int row, std::shared_ptr<Node> item)
+{
+    m_childItems.insert(row, item);
+}
+
+void RowNode::removeChildren(int row, int count)
+{
+    m_childItems.erase(m_childItems.begin() + row, m_childItems.begin() + row + count);
+}
+
 std::shared_ptr<Node> RowNode::child(int row)
 {
     if (row < 0 || row >= m_childItems.size())
@@ -47,9 +71,17 @@ std::shared_ptr<Node> RowNode::parentItem()
 
 QVariant RowNode::data(int column)
 {
-    if (column < 0 || column >= m_itemData.size())
-        return QVariant();
-    return m_itemData.at(column);
+    switch (column) {
+    case 0:
+        return !m_record.faviconData.isNull()
+             ? QVariant(m_record.faviconData)
+             : QVariant(m_record.faviconUrl);
+    case 1: return m_record.title;
+    case 2: return m_record.date;
+    case 3: return QString::fromStdString(kiwix::beautifyFileSize(m_record.size));
+    case 4: return m_record.tags;
+    default: return QVariant();
+    }
 }
 
 int RowNode::row() const
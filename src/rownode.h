@@ -6,21 +6,31 @@
 #include <QIcon>
 #include "kiwix/book.h"
 #include "downloadmanagement.h"
+#include "bookrecord.h"
 
 class RowNode : public Node
 {
 public:
-    explicit RowNode(QList<QVariant> itemData, QString bookId, std::weak_ptr<RowNode> parentItem);
+    explicit RowNode(BookRecord record, std::weak_ptr<RowNode> parentItem);
     ~RowNode();
     std::shared_ptr<Node> parentItem() override;
     std::shared_ptr<Node> child(int row);
     void appendChild(std::shared_ptr<Node> child);
+    void insertChild(int row, std::shared_ptr<Node> child);
+    void removeChildren(int row, int count);
+    void setChildren(const QList<std::shared_ptr<Node>>& children) { m_childItems = children; }
+    const QList<std::shared_ptr<Node>>& children() const { return m_childItems; }
     int childCount() const override;
     int columnCount() const override;
     QVariant data(int column) override;
     int row() const override;
-    QString getBookId() const override { return m_bookId; }
-    void setIconData(QByteArray iconData) { m_itemData[0] = iconData; }
+    QString getBookId() const override { return m_record.id; }
+    void setIconData(QByteArray iconData);
+    const BookRecord& record() const { return m_record; }
+    void setRecord(const BookRecord& record);
+    // The decoded favicon (null if it hasn't been decoded yet)
+    const QIcon& getIcon() const { return m_icon; }
+    void setIcon(const QIcon& icon) { m_icon = icon; }
     bool isChild(Node* candidate);
 
 
@@ -28,10 +38,10 @@ public:
     std::shared_ptr<DownloadState> getDownloadState() { return m_downloadState; }
 
 private:
-    QList<QVariant> m_itemData;
+    BookRecord m_record;
+    QIcon m_icon;
     QList<std::shared_ptr<Node>> m_childItems;
     std::weak_ptr<RowNode> m_parentItem;
-    QString m_bookId;
     std::shared_ptr<DownloadState> m_downloadState;
 };
 
@@ -248,10 +248,6 @@ void SearchBarLineEdit::updateCompletion()
 
 void SearchBarLineEdit::fetchMoreSuggestions()
 {
-    /* TODO: Refactor suggestion worker to re-use zim::SuggestionSearcher for
-       fetching more suggestion in a single archive. Currently we create a
-       searcher for every fetch, and discarded after one use.
-    */
     fetchSuggestions(&SearchBarLineEdit::onAdditionalSuggestions);
 }
 
@@ -56,7 +56,7 @@ SettingsView* SettingsManager::getView()
     if (m_view == nullptr) {
         auto view = new SettingsView();
         view->init(m_zoomFactor * 100, m_downloadDir, m_monitorDir,
-                   m_moveToTrash, m_reopenTab);
+                   m_moveToTrash, m_reopenTab, m_preallocateDownloads);
         connect(view, &QObject::destroyed, this, [=]() { m_view = nullptr; });
         m_view = view;
     }
@@ -129,6 +129,80 @@ void SettingsManager::setMonitorDir(QString monitorDir)
     emit(monitorDirChanged(monitorDir));
 }
 
+// Directories monitored in addition to the monitor and download directories
+void SettingsManager::setExtraMonitorDirs(QStringList extraMonitorDirs)
+{
+    for (auto& dir : extraMonitorDirs) {
+        dir = QDir::toNativeSeparators(dir);
+    }
+    m_extraMonitorDirs = extraMonitorDirs;
+    m_settings.setValue("monitor/extraDirs", extraMonitorDirs);
+    emit(extraMonitorDirsChanged(extraMonitorDirs));
+}
+
+void SettingsManager::setMaxActiveDownloads(int maxActiveDownloads)
+{
+    m_maxActiveDownloads = maxActiveDownloads;
+    m_settings.setValue("download/maxActive", maxActiveDownloads);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setDownloadRateLimit(int rateLimit)
+{
+    m_downloadRateLimit = rateLimit;
+    m_settings.setValue("download/rateLimit", rateLimit);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setGlobalDownloadRateLimit(int rateLimit)
+{
+    m_globalDownloadRateLimit = rateLimit;
+    m_settings.setValue("download/globalRateLimit", rateLimit);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setDownloadQueueOrder(QString queueOrder)
+{
+    m_downloadQueueOrder = queueOrder;
+    m_settings.setValue("download/queueOrder", queueOrder);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setDownloadWindows(QStringList windows)
+{
+    m_downloadWindows = windows;
+    m_settings.setValue("download/windows", windows);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setPauseDownloadsOutsideWindows(bool pause)
+{
+    m_pauseDownloadsOutsideWindows = pause;
+    m_settings.setValue("download/pauseOutsideWindows", pause);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setDownloadRateLimitInsideWindows(int rateLimit)
+{
+    m_downloadRateLimitInsideWindows = rateLimit;
+    m_settings.setValue("download/rateLimitInsideWindows", rateLimit);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setDownloadRateLimitOutsideWindows(int rateLimit)
+{
+    m_downloadRateLimitOutsideWindows = rateLimit;
+    m_settings.setValue("download/rateLimitOutsideWindows", rateLimit);
+    emit(downloadSchedulingChanged());
+}
+
+void SettingsManager::setPreallocateDownloads(bool preallocate)
+{
+    m_preallocateDownloads = preallocate;
+    m_settings.setValue("download/preallocate", preallocate);
+    emit(preallocateDownloadsChanged(preallocate));
+}
+
 void SettingsManager::setMoveToTrash(bool moveToTrash)
 {
     m_moveToTrash = moveToTrash;
@@ -191,7 +265,17 @@ void SettingsManager::initSettings()
     } else {
         m_downloadDir = m_settings.value("download/dir", getDataDirectory()).toString();
         m_monitorDir = m_settings.value("monitor/dir", QString("")).toString();
+        m_extraMonitorDirs = m_settings.value("monitor/extraDirs", QStringList()).toStringList();
     }
+    m_maxActiveDownloads = m_settings.value("download/maxActive", 3).toInt();
+    m_downloadRateLimit = m_settings.value("download/rateLimit", 0).toInt();
+    m_globalDownloadRateLimit = m_settings.value("download/globalRateLimit", 0).toInt();
+    m_downloadQueueOrder = m_settings.value("download/queueOrder", QString("fifo")).toString();
+    m_downloadWindows = m_settings.value("download/windows", QStringList()).toStringList();
+    m_pauseDownloadsOutsideWindows = m_settings.value("download/pauseOutsideWindows", true).toBool();
+    m_downloadRateLimitInsideWindows = m_settings.value("download/rateLimitInsideWindows", 0).toInt();
+    m_downloadRateLimitOutsideWindows = m_settings.value("download/rateLimitOutsideWindows", 0).toInt();
+    m_preallocateDownloads = m_settings.value("download/preallocate", true).toBool();
     m_kiwixServerPort = m_settings.value("localKiwixServer/port", 8080).toInt();
     m_zoomFactor = m_settings.value("view/zoomFactor", 1).toDouble();
     m_kiwixServerIpAddress = m_settings.value("localKiwixServer/ipAddress", QString("0.0.0.0")).toString();
@@ -28,6 +28,16 @@ public:
     qreal getZoomFactor() const { return m_zoomFactor; }
     QString getDownloadDir() const { return m_downloadDir; }
     QString getMonitorDir() const { return m_monitorDir; }
+    QStringList getExtraMonitorDirs() const { return m_extraMonitorDirs; }
+    int getMaxActiveDownloads() const { return m_maxActiveDownloads; }
+    int getDownloadRateLimit() const { return m_downloadRateLimit; }
+    int getGlobalDownloadRateLimit() const { return m_globalDownloadRateLimit; }
+    QString getDownloadQueueOrder() const { return m_downloadQueueOrder; }
+    QStringList getDownloadWindows() const { return m_downloadWindows; }
+    bool getPauseDownloadsOutsideWindows() const { return m_pauseDownloadsOutsideWindows; }
+    int getDownloadRateLimitInsideWindows() const { return m_downloadRateLimitInsideWindows; }
+    int getDownloadRateLimitOutsideWindows() const { return m_downloadRateLimitOutsideWindows; }
+    bool getPreallocateDownloads() const { return m_preallocateDownloads; }
     bool getMoveToTrash() const { return m_moveToTrash; }
     bool getReopenTab() const { return m_reopenTab; }
     FilterList getLanguageList() { return deducePair(m_langList); }
@@ -40,6 +50,16 @@ public slots:
     void setZoomFactor(qreal zoomFactor);
     void setDownloadDir(QString downloadDir);
     void setMonitorDir(QString monitorDir);
+    void setExtraMonitorDirs(QStringList extraMonitorDirs);
+    void setMaxActiveDownloads(int maxActiveDownloads);
+    void setDownloadRateLimit(int rateLimit);
+    void setGlobalDownloadRateLimit(int rateLimit);
+    void setDownloadQueueOrder(QString queueOrder);
+    void setDownloadWindows(QStringList windows);
+    void setPauseDownloadsOutsideWindows(bool pause);
+    void setDownloadRateLimitInsideWindows(int rateLimit);
+    void setDownloadRateLimitOutsideWindows(int rateLimit);
+    void setPreallocateDownloads(bool preallocate);
     void setMoveToTrash(bool moveToTrash);
     void setReopenTab(bool reopenTab);
     void setLanguage(FilterList langList);
@@ -56,6 +76,9 @@ signals:
     void zoomChanged(qreal zoomFactor);
     void downloadDirChanged(QString downloadDir);
     void monitorDirChanged(QString monitorDir);
+    void extraMonitorDirsChanged(QStringList extraMonitorDirs);
+    void downloadSchedulingChanged();
+    void preallocateDownloadsChanged(bool preallocate);
     void moveToTrashChanged(bool moveToTrash);
     void reopenTabChanged(bool reopenTab);
     void languageChanged(QList<QVariant> langList);
@@ -70,6 +93,19 @@ private:
     qreal m_zoomFactor;
     QString m_downloadDir;
     QString m_monitorDir;
+    QStringList m_extraMonitorDirs;
+    int m_maxActiveDownloads;       // 0 means no limit
+    int m_downloadRateLimit;        // per download, in KiB/s, 0 means no limit
+    int m_globalDownloadRateLimit;  // in KiB/s, 0 means no limit
+    QString m_downloadQueueOrder;   // "fifo", "smallest-first" or "priority"
+    // Time windows in the form "HH:mm-HH:mm" (an empty list means that there
+    // are no restrictions). The rate limits inside and outside the windows
+    // apply per download in addition to m_downloadRateLimit.
+    QStringList m_downloadWindows;
+    bool m_pauseDownloadsOutsideWindows;
+    int m_downloadRateLimitInsideWindows;  // in KiB/s, 0 means no limit
+    int m_downloadRateLimitOutsideWindows; // in KiB/s, 0 means no limit
+    bool m_preallocateDownloads;
     bool m_moveToTrash;
     bool m_reopenTab;
     QList<QVariant> m_langList;
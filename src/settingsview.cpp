@@ -5,8 +5,10 @@
 #include <QClipboard>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QDir>
 #include <QToolTip>
 #include <QScrollArea>
+#include <QTime>
 
 namespace 
 {
@@ -39,6 +41,15 @@ SettingsView::SettingsView(QWidget *parent)
     connect(ui->zoomPercentSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setZoom);
     connect(ui->moveToTrashToggle, &QCheckBox::clicked, this, &SettingsView::setMoveToTrash);
     connect(ui->reopenTabToggle, &QCheckBox::clicked, this, &SettingsView::setReopenTab);
+    connect(ui->preallocateDownloadsToggle, &QCheckBox::clicked, this, &SettingsView::setPreallocateDownloads);
+    connect(ui->maxActiveDownloadsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setMaxActiveDownloads);
+    connect(ui->downloadRateLimitSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setDownloadRateLimit);
+    connect(ui->globalDownloadRateLimitSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setGlobalDownloadRateLimit);
+    connect(ui->downloadQueueOrderComboBox, QOverload<int>::of(&QComboBox::activated), this, &SettingsView::setDownloadQueueOrder);
+    connect(ui->downloadWindowsLineEdit, &QLineEdit::editingFinished, this, &SettingsView::setDownloadWindows);
+    connect(ui->pauseDownloadsOutsideWindowsToggle, &QCheckBox::clicked, this, &SettingsView::setPauseDownloadsOutsideWindows);
+    connect(ui->downloadRateLimitInsideWindowsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setDownloadRateLimitInsideWindows);
+    connect(ui->downloadRateLimitOutsideWindowsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsView::setDownloadRateLimitOutsideWindows);
     connect(ui->browseButton, &QPushButton::clicked, this, &SettingsView::browseDownloadDir);
     connect(ui->downloadDirPathCopy, &QPushButton::clicked, [this, settingsMgr]() {
         copySettingsPathToClipboard(settingsMgr->getDownloadDir(), ui->downloadDirPathCopy);
@@ -49,11 +60,16 @@ SettingsView::SettingsView(QWidget *parent)
     connect(ui->resetButton, &QPushButton::clicked, this, &SettingsView::resetDownloadDir);
     connect(ui->monitorBrowse, &QPushButton::clicked, this, &SettingsView::browseMonitorDir);
     connect(ui->monitorClear, &QPushButton::clicked, this, &SettingsView::clearMonitorDir);
+    connect(ui->extraMonitorDirsAdd, &QPushButton::clicked, this, &SettingsView::addExtraMonitorDir);
+    connect(ui->extraMonitorDirsClear, &QPushButton::clicked, this, &SettingsView::clearExtraMonitorDirs);
     connect(settingsMgr, &SettingsManager::downloadDirChanged, this, &SettingsView::onDownloadDirChanged);
     connect(settingsMgr, &SettingsManager::monitorDirChanged, this, &SettingsView::onMonitorDirChanged);
+    connect(settingsMgr, &SettingsManager::extraMonitorDirsChanged, this, &SettingsView::onExtraMonitorDirsChanged);
     connect(settingsMgr, &SettingsManager::zoomChanged, this, &SettingsView::onZoomChanged);
     connect(settingsMgr, &SettingsManager::moveToTrashChanged, this, &SettingsView::onMoveToTrashChanged);
     connect(settingsMgr, &SettingsManager::reopenTabChanged, this, &SettingsView::onReopenTabChanged);
+    connect(settingsMgr, &SettingsManager::preallocateDownloadsChanged, this, &SettingsView::onPreallocateDownloadsChanged);
+    connect(settingsMgr, &SettingsManager::downloadSchedulingChanged, this, &SettingsView::onDownloadSchedulingChanged);
     ui->settingsLabel->setText(gt("settings"));
     ui->zoomPercentLabel->setText(gt("zoom-level-setting"));
     ui->downloadDirLabel->setText(gt("download-directory-setting"));
@@ -62,6 +78,9 @@ SettingsView::SettingsView(QWidget *parent)
     ui->browseButton->setText(gt("browse"));
     ui->monitorClear->setText(gt("clear"));
     ui->monitorBrowse->setText(gt("browse"));
+    ui->extraMonitorDirsLabel->setText(gt("extra-monitor-directories-setting"));
+    ui->extraMonitorDirsClear->setText(gt("clear"));
+    ui->extraMonitorDirsAdd->setText(gt("browse"));
     QIcon copyIcon(":/icons/copy.svg");
     ui->downloadDirPathCopy->setIcon(copyIcon);
     ui->downloadDirPathCopy->setIconSize(QSize(24, 24));
@@ -71,11 +90,33 @@ SettingsView::SettingsView(QWidget *parent)
     ui->monitorHelp->setToolTip(gt("monitor-directory-tooltip"));
     ui->moveToTrashLabel->setText(gt("move-files-to-trash"));
     ui->reopenTabLabel->setText(gt("open-previous-tabs-at-startup"));
+    ui->preallocateDownloadsLabel->setText(gt("preallocate-downloads"));
+    ui->maxActiveDownloadsLabel->setText(gt("max-active-downloads"));
+    ui->downloadRateLimitLabel->setText(gt("download-rate-limit"));
+    ui->globalDownloadRateLimitLabel->setText(gt("global-download-rate-limit"));
+    ui->downloadQueueOrderLabel->setText(gt("download-queue-order"));
+    // A value of 0 means that there is no limit
+    ui->maxActiveDownloadsSpinBox->setSpecialValueText(gt("no-limit"));
+    ui->downloadRateLimitSpinBox->setSpecialValueText(gt("no-limit"));
+    ui->globalDownloadRateLimitSpinBox->setSpecialValueText(gt("no-limit"));
+    ui->downloadQueueOrderComboBox->addItem(gt("download-queue-order-fifo"), "fifo");
+    ui->downloadQueueOrderComboBox->addItem(gt("download-queue-order-smallest-first"), "smallest-first");
+    ui->downloadQueueOrderComboBox->addItem(gt("download-queue-order-priority"), "priority");
+    ui->downloadWindowsLabel->setText(gt("download-windows"));
+    ui->downloadWindowsLineEdit->setPlaceholderText(gt("download-windows-placeholder"));
+    ui->downloadWindowsLineEdit->setToolTip(gt("download-windows-tooltip"));
+    ui->pauseDownloadsOutsideWindowsLabel->setText(gt("pause-downloads-outside-windows"));
+    ui->downloadRateLimitInsideWindowsLabel->setText(gt("download-rate-limit-inside-windows"));
+    ui->downloadRateLimitOutsideWindowsLabel->setText(gt("download-rate-limit-outside-windows"));
+    ui->downloadRateLimitInsideWindowsSpinBox->setSpecialValueText(gt("no-limit"));
+    ui->downloadRateLimitOutsideWindowsSpinBox->setSpecialValueText(gt("no-limit"));
     if(isPortableMode()) {
         disableInPortableMode(ui->browseButton);
         disableInPortableMode(ui->resetButton);
         disableInPortableMode(ui->monitorBrowse);
         disableInPortableMode(ui->monitorClear);
+        disableInPortableMode(ui->extraMonitorDirsAdd);
+        disableInPortableMode(ui->extraMonitorDirsClear);
     }
 #if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
     ui->line_5->hide();
@@ -87,13 +128,16 @@ SettingsView::SettingsView(QWidget *parent)
 
 void SettingsView::init(int zoomPercent, const QString &downloadDir,
                         const QString &monitorDir, const bool moveToTrash,
-                        bool reopentab)
+                        bool reopentab, bool preallocateDownloads)
 {
     ui->zoomPercentSpinBox->setValue(zoomPercent);
     SettingsView::onDownloadDirChanged(downloadDir);
     SettingsView::onMonitorDirChanged(monitorDir);
+    SettingsView::onExtraMonitorDirsChanged(KiwixApp::instance()->getSettingsManager()->getExtraMonitorDirs());
     ui->moveToTrashToggle->setChecked(moveToTrash);
     ui->reopenTabToggle->setChecked(reopentab);
+    ui->preallocateDownloadsToggle->setChecked(preallocateDownloads);
+    SettingsView::onDownloadSchedulingChanged();
 }
 bool SettingsView::confirmDialog( QString messageText, QString messageTitle)
 {
@@ -178,6 +222,33 @@ void SettingsView::clearMonitorDir()
     }
 }
 
+void SettingsView::addExtraMonitorDir()
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    auto extraMonitorDirs = settingsMgr->getExtraMonitorDirs();
+    QString dir = QFileDialog::getExistingDirectory(KiwixApp::instance()->getMainWindow(),
+                                                    gt("browse-directory"),
+                                                    settingsMgr->getDownloadDir(),
+                                                    QFileDialog::ShowDirsOnly);
+    dir = QDir::toNativeSeparators(dir);
+    if (dir.isEmpty() || extraMonitorDirs.contains(dir)) {
+        return;
+    }
+    auto messageText = gt("extra-monitor-dir-dialog-msg");
+    messageText = messageText.replace("{{DIRECTORY}}", dir);
+    if (confirmDialog(messageText, gt("extra-monitor-dir-dialog-title"))) {
+        extraMonitorDirs.append(dir);
+        settingsMgr->setExtraMonitorDirs(extraMonitorDirs);
+    }
+}
+
+void SettingsView::clearExtraMonitorDirs()
+{
+    if (confirmDialog(gt("extra-monitor-clear-dirs-dialog-msg"), gt("extra-monitor-clear-dirs-dialog-title"))) {
+        KiwixApp::instance()->getSettingsManager()->setExtraMonitorDirs(QStringList());
+    }
+}
+
 void SettingsView::setZoom(int zoomPercent)
 {
     qreal zoomFactor = (qreal) zoomPercent/100;
@@ -194,6 +265,77 @@ void SettingsView::setReopenTab(bool reopen)
     KiwixApp::instance()->getSettingsManager()->setReopenTab(reopen);
 }
 
+void SettingsView::setPreallocateDownloads(bool preallocate)
+{
+    KiwixApp::instance()->getSettingsManager()->setPreallocateDownloads(preallocate);
+}
+
+void SettingsView::setMaxActiveDownloads(int maxActiveDownloads)
+{
+    KiwixApp::instance()->getSettingsManager()->setMaxActiveDownloads(maxActiveDownloads);
+}
+
+void SettingsView::setDownloadRateLimit(int rateLimit)
+{
+    KiwixApp::instance()->getSettingsManager()->setDownloadRateLimit(rateLimit);
+}
+
+void SettingsView::setGlobalDownloadRateLimit(int rateLimit)
+{
+    KiwixApp::instance()->getSettingsManager()->setGlobalDownloadRateLimit(rateLimit);
+}
+
+void SettingsView::setDownloadQueueOrder(int index)
+{
+    const auto queueOrder = ui->downloadQueueOrderComboBox->itemData(index).toString();
+    KiwixApp::instance()->getSettingsManager()->setDownloadQueueOrder(queueOrder);
+}
+
+// The windows are entered as a comma separated list of "HH:mm-HH:mm"
+// ranges. An invalid list is rejected and the current one is shown again.
+void SettingsView::setDownloadWindows()
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    QStringList windows;
+    for ( auto window : ui->downloadWindowsLineEdit->text().split(',') ) {
+        window = window.simplified().remove(' ');
+        if ( window.isEmpty() )
+            continue;
+
+        const QStringList bounds = window.split('-');
+        if ( bounds.size() != 2
+             || !QTime::fromString(bounds[0], "HH:mm").isValid()
+             || !QTime::fromString(bounds[1], "HH:mm").isValid() ) {
+            QToolTip::showText(ui->downloadWindowsLineEdit->mapToGlobal(QPoint(0, 0)),
+                               gt("download-windows-invalid"), ui->downloadWindowsLineEdit);
+            onDownloadSchedulingChanged();
+            return;
+        }
+        windows.append(window);
+    }
+
+    if ( windows != settingsMgr->getDownloadWindows() ) {
+        settingsMgr->setDownloadWindows(windows);
+    } else {
+        onDownloadSchedulingChanged();
+    }
+}
+
+void SettingsView::setPauseDownloadsOutsideWindows(bool pause)
+{
+    KiwixApp::instance()->getSettingsManager()->setPauseDownloadsOutsideWindows(pause);
+}
+
+void SettingsView::setDownloadRateLimitInsideWindows(int rateLimit)
+{
+    KiwixApp::instance()->getSettingsManager()->setDownloadRateLimitInsideWindows(rateLimit);
+}
+
+void SettingsView::setDownloadRateLimitOutsideWindows(int rateLimit)
+{
+    KiwixApp::instance()->getSettingsManager()->setDownloadRateLimitOutsideWindows(rateLimit);
+}
+
 void SettingsView::onDownloadDirChanged(const QString &dir)
 {
     ui->downloadDirPath->setText(formatSettingsDir(dir));
@@ -215,6 +357,17 @@ void SettingsView::onMonitorDirChanged(const QString &dir)
     ui->monitorDirPath->setToolTip(dir);
 }
 
+void SettingsView::onExtraMonitorDirsChanged(const QStringList &dirs)
+{
+    QStringList formattedDirs;
+    for (const auto& dir : dirs) {
+        formattedDirs.append(formatSettingsDir(dir));
+    }
+    ui->extraMonitorDirsClear->setVisible(!dirs.isEmpty());
+    ui->extraMonitorDirsPaths->setText(formattedDirs.join("\n"));
+    ui->extraMonitorDirsPaths->setToolTip(dirs.join("\n"));
+}
+
 void SettingsView::onZoomChanged(qreal zoomFactor)
 {
     qreal zoomPercent = zoomFactor * 100;
@@ -230,3 +383,35 @@ void SettingsView::onReopenTabChanged(bool reopen)
 {
     ui->reopenTabToggle->setChecked(reopen);
 }
+
+void SettingsView::onPreallocateDownloadsChanged(bool preallocate)
+{
+    ui->preallocateDownloadsToggle->setChecked(preallocate);
+}
+
+// The controls are updated without signalling, so that they don't write
+// the settings back
+void SettingsView::onDownloadSchedulingChanged()
+{
+    const auto settingsMgr = KiwixApp::instance()->getSettingsManager();
+    const QSignalBlocker maxActiveDownloadsBlocker(ui->maxActiveDownloadsSpinBox);
+    const QSignalBlocker downloadRateLimitBlocker(ui->downloadRateLimitSpinBox);
+    const QSignalBlocker globalDownloadRateLimitBlocker(ui->globalDownloadRateLimitSpinBox);
+    const QSignalBlocker insideWindowsBlocker(ui->downloadRateLimitInsideWindowsSpinBox);
+    const QSignalBlocker outsideWindowsBlocker(ui->downloadRateLimitOutsideWindowsSpinBox);
+    ui->maxActiveDownloadsSpinBox->setValue(settingsMgr->getMaxActiveDownloads());
+    ui->downloadRateLimitSpinBox->setValue(settingsMgr->getDownloadRateLimit());
+    ui->globalDownloadRateLimitSpinBox->setValue(settingsMgr->getGlobalDownloadRateLimit());
+    const int queueOrderIndex = ui->downloadQueueOrderComboBox->findData(settingsMgr->getDownloadQueueOrder());
+    ui->downloadQueueOrderComboBox->setCurrentIndex(qMax(queueOrderIndex, 0));
+
+    const auto downloadWindows = settingsMgr->getDownloadWindows();
+    ui->downloadWindowsLineEdit->setText(downloadWindows.join(", "));
+    ui->pauseDownloadsOutsideWindowsToggle->setChecked(settingsMgr->getPauseDownloadsOutsideWindows());
+    ui->downloadRateLimitInsideWindowsSpinBox->setValue(settingsMgr->getDownloadRateLimitInsideWindows());
+    ui->downloadRateLimitOutsideWindowsSpinBox->setValue(settingsMgr->getDownloadRateLimitOutsideWindows());
+    // These settings only matter if there are download windows
+    ui->pauseDownloadsOutsideWindowsToggle->setEnabled(!downloadWindows.isEmpty());
+    ui->downloadRateLimitInsideWindowsSpinBox->setEnabled(!downloadWindows.isEmpty());
+    ui->downloadRateLimitOutsideWindowsSpinBox->setEnabled(!downloadWindows.isEmpty());
+}
@@ -15,21 +15,35 @@ public:
     ~SettingsView(){};
     void init(int zoomPercent, const QString &downloadDir,
               const QString &monitorDir, const bool moveToTrash,
-              bool reopentab);
+              bool reopentab, bool preallocateDownloads);
   public Q_SLOTS:
     void resetDownloadDir();
     void browseDownloadDir();
     void browseMonitorDir();
     void clearMonitorDir();
+    void addExtraMonitorDir();
+    void clearExtraMonitorDirs();
     void setZoom(int zoomPercent);
     void setMoveToTrash(bool moveToTrash);
     void setReopenTab(bool reopen);
+    void setPreallocateDownloads(bool preallocate);
+    void setMaxActiveDownloads(int maxActiveDownloads);
+    void setDownloadRateLimit(int rateLimit);
+    void setGlobalDownloadRateLimit(int rateLimit);
+    void setDownloadQueueOrder(int index);
+    void setDownloadWindows();
+    void setPauseDownloadsOutsideWindows(bool pause);
+    void setDownloadRateLimitInsideWindows(int rateLimit);
+    void setDownloadRateLimitOutsideWindows(int rateLimit);
     void onDownloadDirChanged(const QString &dir);
     void copySettingsPathToClipboard(QString pathToCopy, QPushButton* button);
     void onMonitorDirChanged(const QString &dir);
+    void onExtraMonitorDirsChanged(const QStringList &dirs);
     void onZoomChanged(qreal zoomFactor);
     void onMoveToTrashChanged(bool moveToTrash);
     void onReopenTabChanged(bool reopen);
+    void onPreallocateDownloadsChanged(bool preallocate);
+    void onDownloadSchedulingChanged();
 private:
     bool confirmDialogDownloadDir(const QString& dir);
     bool confirmDialog(QString messageText, QString messageTitle);
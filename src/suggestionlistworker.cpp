@@ -24,16 +24,13 @@ void SuggestionListWorker::run()
         QUrl url;
         url.setScheme("zim");
         url.setHost(currentZimId + ".zim");
-        auto prefix = m_text.toStdString();
-        auto suggestionSearcher = zim::SuggestionSearcher(*archive);
-        auto suggestionSearch = suggestionSearcher.suggest(prefix);
-        const auto suggestions = suggestionSearch.getResults(m_start, getFetchSize());
-        for (auto current : suggestions) {
+        app->getLibrary()->getSuggestions(currentZimId, m_text, m_start, getFetchSize(),
+                                          [&](const zim::SuggestionItem& current) {
             QString path = QString("/") + QString::fromStdString(current.getPath());
             url.setPath(path);
             const auto text = QString::fromStdString(current.getTitle());
             suggestionList.append({text, url});
-        }
+        });
 
         // Propose fulltext search
         url.setPath("");
@@ -1,48 +1,131 @@
 #include "thumbnaildownloader.h"
+#include "settingsmanager.h"
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QPixmap>
 #include <QIcon>
+#include <memory>
 
+namespace
+{
+
+// Same as the number of connections per host opened by QNetworkAccessManager
+const int MAX_CONCURRENT_DOWNLOADS = 6;
+
+// Enough for the thumbnails of the whole catalog
+const qint64 MAX_CACHE_SIZE = 32 * 1024 * 1024;
+
+} // unnamed namespace
+
+// The thumbnails are cached on disk across restarts. QNetworkDiskCache evicts
+// the oldest entries first, and revalidating an entry rewrites it, hence the
+// thumbnails shown recently are the last ones to be evicted.
 ThumbnailDownloader::ThumbnailDownloader()
+    : mp_cache(new QNetworkDiskCache())
 {
-    connect(this, &ThumbnailDownloader::oneThumbnailDownloaded,
-            this, &ThumbnailDownloader::startNextDownload);
+    mp_cache->setCacheDirectory(getDataDirectory() + "/thumbnail-cache");
+    mp_cache->setMaximumCacheSize(MAX_CACHE_SIZE);
+    manager.setCache(mp_cache);
 }
 
 ThumbnailDownloader::~ThumbnailDownloader()
 {
 }
 
+// Thumbnails are requested while their rows are being painted, hence the most
+// recently requested ones belong to the rows currently visible. They are moved
+// to the front of the queue, and a URL is never downloaded twice at once.
 void ThumbnailDownloader::addDownload(QString url, ThumbnailId index)
 {
-    m_downloadQueue.append({index, url});
-    if (!m_isDownloading)
-        startNextDownload();
+    auto& requesters = m_requesters[url];
+    const bool newRequester = !requesters.contains(index);
+    requesters.insert(index);
+
+    // The thumbnails requesting a URL being revalidated get the cached data
+    // too, the revalidation only delivers the data if it has changed
+    const auto servedFromCache = m_servedFromCache.constFind(url);
+    if (servedFromCache != m_servedFromCache.constEnd()) {
+        if (newRequester)
+            deliverCachedThumbnail(index, url, servedFromCache.value());
+        return;
+    }
+
+    if (m_inFlightUrls.contains(url))
+        return;
+
+    // A cached thumbnail is delivered right away and revalidated after the
+    // thumbnails that aren't cached have been downloaded
+    const QByteArray cachedData = readCachedThumbnail(url);
+    if (!cachedData.isNull()) {
+        m_servedFromCache.insert(url, cachedData);
+        deliverCachedThumbnail(index, url, cachedData);
+        if (!m_downloadQueue.contains(url))
+            m_downloadQueue.append(url);
+        startDownloads();
+        return;
+    }
+
+    m_downloadQueue.removeOne(url);
+    m_downloadQueue.prepend(url);
+    startDownloads();
 }
 
-void ThumbnailDownloader::startNextDownload()
+void ThumbnailDownloader::clearQueue()
 {
-    if (m_downloadQueue.size() == 0) {
-        m_isDownloading = false;
-        return;
+    for (const auto& url : m_downloadQueue) {
+        m_requesters.remove(url);
+        m_servedFromCache.remove(url);
     }
-    m_isDownloading = true;
-    downloadThumbnail(m_downloadQueue.takeFirst());
+    m_downloadQueue.clear();
+}
+
+QByteArray ThumbnailDownloader::readCachedThumbnail(const QString& url) const
+{
+    const std::unique_ptr<QIODevice> cachedData(mp_cache->data(QUrl(url)));
+    return cachedData ? cachedData->readAll() : QByteArray();
+}
+
+// The thumbnail is delivered asynchronously, as the downloaded ones are
+void ThumbnailDownloader::deliverCachedThumbnail(ThumbnailId index, QString url, QByteArray data)
+{
+    QMetaObject::invokeMethod(this, [=]() {
+        emit oneThumbnailDownloaded(index, url, data);
+    }, Qt::QueuedConnection);
 }
 
-void ThumbnailDownloader::downloadThumbnail(ThumbnailInfo thumbnailInfo)
+void ThumbnailDownloader::startDownloads()
 {
-    QNetworkRequest req(thumbnailInfo.second);
+    while (m_inFlightUrls.size() < MAX_CONCURRENT_DOWNLOADS && !m_downloadQueue.isEmpty()) {
+        downloadThumbnail(m_downloadQueue.takeFirst());
+    }
+}
+
+void ThumbnailDownloader::downloadThumbnail(QString url)
+{
+    m_inFlightUrls.insert(url);
+    QNetworkRequest req(url);
     auto reply = manager.get(req);
     connect(reply, &QNetworkReply::finished, this, [=](){
-        fileDownloaded(reply, thumbnailInfo);
+        fileDownloaded(reply, url);
     });
 }
 
-void ThumbnailDownloader::fileDownloaded(QNetworkReply *pReply, ThumbnailInfo thumbnailInfo)
+void ThumbnailDownloader::fileDownloaded(QNetworkReply *pReply, QString url)
 {
     auto downloadedData = pReply->readAll();
-    emit oneThumbnailDownloaded(thumbnailInfo.first, thumbnailInfo.second, downloadedData);
     pReply->deleteLater();
+    m_inFlightUrls.remove(url);
+    const auto requesters = m_requesters.take(url);
+
+    // The delivered cached thumbnail is kept if it is still valid or if it
+    // couldn't be revalidated
+    const bool servedFromCache = m_servedFromCache.remove(url) > 0;
+    const bool unchanged = pReply->error() != QNetworkReply::NoError
+                        || pReply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool();
+    if (!servedFromCache || !unchanged) {
+        for (const auto& thumbnailId : requesters) {
+            emit oneThumbnailDownloaded(thumbnailId, url, downloadedData);
+        }
+    }
+    startDownloads();
 }
@@ -2,8 +2,11 @@
 #define THUMBNAILDOWNLOADER_H
 
 #include <QObject>
-#include <QQueue>
+#include <QList>
+#include <QHash>
+#include <QSet>
 #include <QNetworkAccessManager>
+#include <QNetworkDiskCache>
 #include <QNetworkReply>
 
 class ThumbnailDownloader : public QObject
@@ -12,29 +15,37 @@ class ThumbnailDownloader : public QObject
 
 public:
     typedef QString ThumbnailId;
-    typedef QPair<ThumbnailId, QString> ThumbnailInfo;
 
 public:
     ThumbnailDownloader();
     ~ThumbnailDownloader();
 
     void addDownload(QString url, ThumbnailId index);
-    void startNextDownload();
-    void clearQueue() { m_downloadQueue.clear(); }
+    void clearQueue();
 
 private:
-    void downloadThumbnail(ThumbnailInfo thumbnailInfo);
+    void startDownloads();
+    void downloadThumbnail(QString url);
+    QByteArray readCachedThumbnail(const QString& url) const;
+    void deliverCachedThumbnail(ThumbnailId index, QString url, QByteArray data);
 
 signals:
     void oneThumbnailDownloaded(ThumbnailId, QString, QByteArray);
 
 private:
-    QQueue<ThumbnailInfo> m_downloadQueue;
+    // URLs waiting to be downloaded, the next one first
+    QList<QString> m_downloadQueue;
+    QSet<QString> m_inFlightUrls;
+    // Thumbnails waiting for the data of every queued or in-flight URL
+    QHash<QString, QSet<ThumbnailId>> m_requesters;
+    // URLs whose cached thumbnail (the value) has been delivered and is being
+    // revalidated
+    QHash<QString, QByteArray> m_servedFromCache;
     QNetworkAccessManager manager;
-    bool m_isDownloading = false;
+    QNetworkDiskCache* mp_cache; // owned by manager
 
 private slots:
-    void fileDownloaded(QNetworkReply *pReply, ThumbnailInfo thumbnailInfo);
+    void fileDownloaded(QNetworkReply *pReply, QString url);
 
 };
 
@@ -0,0 +1,243 @@
+#include "zimintegritychecker.h"
+#include "settingsmanager.h"
+#include <zim/archive.h>
+#include <zim/error.h>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+
+namespace
+{
+
+// Reading the whole file for the checksum is throttled so that the
+// background verification doesn't slow down the rest of the system (and the
+// reading of the very same ZIM files by the user)
+const qint64 MAX_BACKGROUND_READ_BYTES_PER_SECOND = 16 * 1024 * 1024;
+const qint64 READ_CHUNK_SIZE = 1024 * 1024;
+
+// The MD5 checksum of a ZIM file is stored in its last 16 bytes
+const qint64 ZIM_CHECKSUM_SIZE = 16;
+
+QString getResultsFilePath()
+{
+    return getDataDirectory() + "/zim-integrity-checks.ini";
+}
+
+} // unnamed namespace
+
+ZimIntegrityChecker::ZimIntegrityChecker(QObject* parent)
+    : QObject(parent)
+{
+    loadResults();
+
+    mp_thread = QThread::create([=]() {
+        processQueue();
+    });
+    mp_thread->start(QThread::IdlePriority);
+}
+
+ZimIntegrityChecker::~ZimIntegrityChecker()
+{
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_stopRequested = true;
+        m_queueNotEmpty.wakeAll();
+    }
+    mp_thread->wait();
+    delete mp_thread;
+}
+
+// The files are not examined here (this is called from the GUI thread)
+void ZimIntegrityChecker::checkBooks(const QList<BookFile>& bookFiles)
+{
+    const QMutexLocker locker(&m_mutex);
+    for (const auto& bookFile : bookFiles) {
+        if ( !m_queue.contains(bookFile) ) {
+            m_queue.enqueue(bookFile);
+        }
+    }
+    m_queueNotEmpty.wakeAll();
+}
+
+// Must be called with m_mutex locked
+bool ZimIntegrityChecker::hasUpToDateResult(const BookFile& bookFile, const FileStatus& fileStatus) const
+{
+    const auto it = m_results.constFind(bookFile.first);
+    return it != m_results.constEnd()
+        && it->path == fileStatus.path
+        && it->size == fileStatus.size
+        && it->lastModified == fileStatus.lastModified;
+}
+
+bool ZimIntegrityChecker::isCorrupted(const QString& bookId) const
+{
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_results.constFind(bookId);
+    return it != m_results.constEnd() && it->corrupted;
+}
+
+void ZimIntegrityChecker::setResult(const QString& bookId, const QString& path, bool corrupted)
+{
+    const FileStatus status = getFileStatus(path, corrupted);
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_queue.removeAll({bookId, path});
+        m_results.insert(bookId, status);
+        saveResult(bookId, status);
+    }
+    emit(bookChecked(bookId, corrupted));
+}
+
+ZimIntegrityChecker::FileStatus ZimIntegrityChecker::getFileStatus(const QString& path, bool corrupted)
+{
+    FileStatus status;
+    status.path = path;
+    const QFileInfo fileInfo(path);
+    status.size = fileInfo.size();
+    status.lastModified = fileInfo.lastModified();
+    status.corrupted = corrupted;
+    return status;
+}
+
+void ZimIntegrityChecker::processQueue()
+{
+    while ( true ) {
+        BookFile bookFile;
+        {
+            QMutexLocker locker(&m_mutex);
+            while ( m_queue.isEmpty() && !m_stopRequested ) {
+                m_queueNotEmpty.wait(&m_mutex);
+            }
+            if ( m_stopRequested )
+                return;
+            bookFile = m_queue.dequeue();
+        }
+
+        const FileStatus currentStatus = getFileStatus(bookFile.second, false);
+        {
+            const QMutexLocker locker(&m_mutex);
+            if ( hasUpToDateResult(bookFile, currentStatus) )
+                continue;
+
+            // the file has to be checked (again)
+            m_results.remove(bookFile.first);
+        }
+
+        const CheckResult result = checkZimFile(bookFile.second,
+                                                MAX_BACKGROUND_READ_BYTES_PER_SECOND,
+                                                m_stopRequested);
+        if ( result == CheckResult::INTERRUPTED )
+            return; // the file will be checked after the next start
+
+        const FileStatus status = getFileStatus(bookFile.second, result == CheckResult::CORRUPTED);
+        {
+            const QMutexLocker locker(&m_mutex);
+            // A newer request for that book means that the file has changed
+            // in the meantime
+            if ( m_queue.contains(bookFile) )
+                continue;
+            m_results.insert(bookFile.first, status);
+            saveResult(bookFile.first, status);
+        }
+        emit(bookChecked(bookFile.first, status.corrupted));
+    }
+}
+
+ZimIntegrityChecker::CheckResult ZimIntegrityChecker::checkZimFile(const QString& path,
+                                                                   qint64 maxBytesPerSecond,
+                                                                   const std::atomic<bool>& stopRequested,
+                                                                   const ProgressCallback& progress)
+{
+    QByteArray expectedMd5;
+    try {
+        zim::Archive archive(path.toStdString());
+
+        // These checks only read the (comparatively small) pointer lists and
+        // the title index
+        if ( !archive.checkIntegrity(zim::IntegrityCheck::DIRENT_PTRS)
+          || !archive.checkIntegrity(zim::IntegrityCheck::CLUSTER_PTRS)
+          || !archive.checkIntegrity(zim::IntegrityCheck::TITLE_INDEX) ) {
+            return CheckResult::CORRUPTED;
+        }
+
+        if ( !archive.hasChecksum() )
+            return CheckResult::HEALTHY;
+        expectedMd5 = QByteArray::fromStdString(archive.getChecksum());
+    } catch (const std::exception&) {
+        return CheckResult::CORRUPTED;
+    }
+
+    return verifyChecksum(path, expectedMd5, maxBytesPerSecond, stopRequested, progress);
+}
+
+// Same as zim::Archive::checkIntegrity(zim::IntegrityCheck::CHECKSUM) but the
+// reading is throttled and can be interrupted
+ZimIntegrityChecker::CheckResult ZimIntegrityChecker::verifyChecksum(const QString& path,
+                                                                     const QByteArray& expectedMd5,
+                                                                     qint64 maxBytesPerSecond,
+                                                                     const std::atomic<bool>& stopRequested,
+                                                                     const ProgressCallback& progress)
+{
+    QFile file(path);
+    if ( !file.open(QIODevice::ReadOnly) || file.size() < ZIM_CHECKSUM_SIZE )
+        return CheckResult::CORRUPTED;
+
+    const qint64 dataSize = file.size() - ZIM_CHECKSUM_SIZE;
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytesRead = 0;
+    while ( bytesRead < dataSize ) {
+        if ( stopRequested )
+            return CheckResult::INTERRUPTED;
+
+        const QByteArray chunk = file.read(qMin(READ_CHUNK_SIZE, dataSize - bytesRead));
+        if ( chunk.isEmpty() )
+            return CheckResult::CORRUPTED;
+        md5.addData(chunk);
+        bytesRead += chunk.size();
+        if ( progress ) {
+            progress(double(bytesRead) / dataSize);
+        }
+
+        if ( maxBytesPerSecond > 0 ) {
+            const qint64 dueTimeMs = bytesRead * 1000 / maxBytesPerSecond;
+            const qint64 aheadMs = dueTimeMs - timer.elapsed();
+            if ( aheadMs > 0 ) {
+                QThread::msleep(aheadMs);
+            }
+        }
+    }
+
+    return md5.result().toHex() == expectedMd5.toLower()
+         ? CheckResult::HEALTHY
+         : CheckResult::CORRUPTED;
+}
+
+void ZimIntegrityChecker::loadResults()
+{
+    QSettings settings(getResultsFilePath(), QSettings::IniFormat);
+    for (const auto& bookId : settings.childGroups()) {
+        settings.beginGroup(bookId);
+        FileStatus status;
+        status.path = settings.value("path").toString();
+        status.size = settings.value("size", -1).toLongLong();
+        status.lastModified = settings.value("lastModified").toDateTime();
+        status.corrupted = settings.value("corrupted", false).toBool();
+        settings.endGroup();
+        m_results.insert(bookId, status);
+    }
+}
+
+void ZimIntegrityChecker::saveResult(const QString& bookId, const FileStatus& status)
+{
+    QSettings settings(getResultsFilePath(), QSettings::IniFormat);
+    settings.beginGroup(bookId);
+    settings.setValue("path", status.path);
+    settings.setValue("size", status.size);
+    settings.setValue("lastModified", status.lastModified);
+    settings.setValue("corrupted", status.corrupted);
+    settings.endGroup();
+}
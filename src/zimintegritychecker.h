@@ -0,0 +1,93 @@
+#ifndef ZIMINTEGRITYCHECKER_H
+#define ZIMINTEGRITYCHECKER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+
+// Verifies the local ZIM files in a low priority background thread (checking
+// the structure of the archive and its MD5 checksum) so that corrupted files
+// are detected before they fail in the middle of reading an article.
+//
+// The results are saved as soon as they are obtained, hence after a restart
+// only the files that haven't been checked yet (or have changed since they
+// were checked) are verified.
+class ZimIntegrityChecker : public QObject
+{
+    Q_OBJECT
+
+public: // types
+    // book id and path of its ZIM file
+    typedef QPair<QString, QString> BookFile;
+
+    enum class CheckResult
+    {
+        HEALTHY,
+        CORRUPTED,
+        INTERRUPTED
+    };
+
+    // Called with the share (0..1) of the file verified so far
+    typedef std::function<void(double)> ProgressCallback;
+
+public: // functions
+    explicit ZimIntegrityChecker(QObject* parent = nullptr);
+    ~ZimIntegrityChecker();
+
+    // Enqueues the files of the books. The worker thread skips those that
+    // have been checked already and haven't been modified since then.
+    void checkBooks(const QList<BookFile>& bookFiles);
+
+    bool isCorrupted(const QString& bookId) const;
+
+    // Records the result of a check performed elsewhere (see checkZimFile())
+    void setResult(const QString& bookId, const QString& path, bool corrupted);
+
+    // Checks the file synchronously. Reading it is throttled to
+    // maxBytesPerSecond (unless it is 0) and stops when stopRequested is set.
+    static CheckResult checkZimFile(const QString& path,
+                                    qint64 maxBytesPerSecond,
+                                    const std::atomic<bool>& stopRequested,
+                                    const ProgressCallback& progress = ProgressCallback());
+
+signals:
+    void bookChecked(QString bookId, bool corrupted);
+
+private: // types
+    struct FileStatus
+    {
+        QString path;
+        qint64 size = -1;
+        QDateTime lastModified;
+        bool corrupted = false;
+    };
+
+private: // functions
+    void processQueue();
+    bool hasUpToDateResult(const BookFile& bookFile, const FileStatus& fileStatus) const;
+    static CheckResult verifyChecksum(const QString& path,
+                                      const QByteArray& expectedMd5,
+                                      qint64 maxBytesPerSecond,
+                                      const std::atomic<bool>& stopRequested,
+                                      const ProgressCallback& progress);
+    static FileStatus getFileStatus(const QString& path, bool corrupted);
+    void loadResults();
+    void saveResult(const QString& bookId, const FileStatus& status);
+
+private: // data
+    mutable QMutex m_mutex;
+    QWaitCondition m_queueNotEmpty;
+    QQueue<BookFile> m_queue;            // guarded by m_mutex
+    QMap<QString, FileStatus> m_results; // guarded by m_mutex
+    std::atomic<bool> m_stopRequested{false};
+    QThread* mp_thread = nullptr;
+};
+
+#endif // ZIMINTEGRITYCHECKER_H